@@ -48,4 +48,4 @@ $COMPILER src/graphics/asteroids_gen.cpp $CFLAGS -include pch.hpp -O2 -g0 -c -o
 wait
 
 echo "linking..."
-$COMPILER -Wl,-rpath=\$ORIGIN $(find $OBJ_PATH -name "*.cpp.o") -o $EXE_NAME $($PKG_CONFIG --libs sdl2 gl) -lnoise
+$COMPILER -Wl,-rpath=\$ORIGIN $(find $OBJ_PATH -name "*.cpp.o") -o $EXE_NAME $($PKG_CONFIG --libs sdl2 gl) -lnoise -pthread
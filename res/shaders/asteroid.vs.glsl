@@ -1,7 +1,7 @@
 #extension GL_ARB_shader_draw_parameters : require
 
 layout(location=0) in vec3 position_in;
-layout(location=1) in vec3 lowerLodPos_in;
+layout(location=1) in vec3 lowerLodDelta_in;
 layout(location=2) in vec4 normal_in;
 
 #include rendersettings.glh
@@ -16,7 +16,7 @@ const float textureScale = 0.05;
 
 void main() {
 	vec3 scaledPos;
-	worldPos_v = transformToWorld(position_in, lowerLodPos_in, NORMAL_LOD_BIAS, scaledPos);
+	worldPos_v = transformToWorld(position_in, lowerLodDelta_in, NORMAL_LOD_BIAS, scaledPos);
 	texPos_v = scaledPos * textureScale;
 	normal_v = normal_in.xyz;
 	drawIndex_v = gl_DrawIDARB;
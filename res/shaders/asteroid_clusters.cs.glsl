@@ -0,0 +1,113 @@
+layout(local_size_x=64, local_size_y=1, local_size_z=1) in;
+
+layout(binding=0, std430) readonly buffer AsteroidTransformsTSBuf {
+	vec4 transformTS[];
+};
+
+#include asteroid_rotation.glh
+
+#define ASTEROID_SETTINGS_BINDING 2
+#include asteroid_settings.glh
+
+layout(binding=3, std430) buffer AsteroidDrawArgsBuf {
+	uint drawArgs[];
+};
+
+struct ClusterBounds {
+	vec4 sphere;
+	vec4 cone;
+};
+
+layout(binding=4, std430) readonly buffer ClusterBoundsBuf {
+	ClusterBounds clusterBounds[];
+};
+
+//Written by asteroids.cs.glsl, the asteroid index and lod of each asteroid that gets cluster culling
+layout(binding=5, std430) readonly buffer ClusterCullListBuf {
+	uint clusterCullCount;
+	uvec2 clusterCullList[];
+};
+
+//The static lod indices followed by one range of compacted indices for every slot in the cull list,
+// indices are 16 bits so two are stored in each element
+layout(binding=6, std430) buffer IndicesBuf {
+	uint indexPairs[];
+};
+
+#include rendersettings.glh
+#include asteroid_lod.glh
+
+//per-frame uniforms
+uniform vec4 frustumPlanes[6];
+
+//constant uniforms
+uniform uint lodFirstIndex[NUM_LOD_LEVELS];
+uniform uint lodFirstCluster[NUM_LOD_LEVELS];
+uniform uint lodNumClusters[NUM_LOD_LEVELS];
+uniform uint clustersPerVariant;
+uniform uint verticesPerVariant;
+uniform uint compactedFirstIndex;
+uniform uint compactedIndicesPerSlot;
+
+const uint CLUSTER_TRIANGLES = 64;
+const uint CLUSTER_INDEX_PAIRS = CLUSTER_TRIANGLES * 3 / 2;
+const uint MAX_CLUSTERS = 128;
+
+shared uint numVisibleClusters;
+shared uint visibleClusters[MAX_CLUSTERS];
+
+bool isClusterVisible(ClusterBounds bounds, vec3 asteroidPos, mat3 rotation, float scale) {
+	vec3 center = rotation * (bounds.sphere.xyz * scale) + asteroidPos;
+	float radius = bounds.sphere.w * scale;
+	
+	for (int i = 0; i < 6; i++) {
+		if (dot(vec4(center, 1), frustumPlanes[i]) < -radius)
+			return false;
+	}
+	
+	//Every triangle in the cluster faces away from the camera
+	vec3 toCenter = center - rs.cameraPos;
+	return dot(toCenter, rotation * bounds.cone.xyz) < bounds.cone.w * length(toCenter) + radius;
+}
+
+void main() {
+	uint slot = gl_WorkGroupID.x;
+	if (slot >= clusterCullCount)
+		return;
+	
+	uint asteroidIdx = clusterCullList[slot].x;
+	uint lod = clusterCullList[slot].y;
+	uint variant = asteroidSettings[asteroidIdx].firstVertex / verticesPerVariant;
+	uint firstCluster = variant * clustersPerVariant + lodFirstCluster[lod];
+	
+	vec4 transform = transformTS[asteroidIdx];
+	float scale = unpackUnorm2x16(floatBitsToUint(transform.w)).x;
+	mat3 rotation = getRotation(asteroidIdx);
+	
+	if (gl_LocalInvocationIndex == 0) {
+		numVisibleClusters = 0;
+	}
+	barrier();
+	
+	for (uint cluster = gl_LocalInvocationIndex; cluster < lodNumClusters[lod]; cluster += gl_WorkGroupSize.x) {
+		if (isClusterVisible(clusterBounds[firstCluster + cluster], transform.xyz, rotation, scale)) {
+			visibleClusters[atomicAdd(numVisibleClusters, 1)] = cluster;
+		}
+	}
+	barrier();
+	
+	//Copies the indices of the visible clusters into this slot's range
+	uint dstFirstIndex = compactedFirstIndex + slot * compactedIndicesPerSlot;
+	uint numPairs = numVisibleClusters * CLUSTER_INDEX_PAIRS;
+	for (uint i = gl_LocalInvocationIndex; i < numPairs; i += gl_WorkGroupSize.x) {
+		uint cluster = visibleClusters[i / CLUSTER_INDEX_PAIRS];
+		uint srcFirstIndex = lodFirstIndex[lod] + cluster * CLUSTER_TRIANGLES * 3;
+		indexPairs[dstFirstIndex / 2 + i] = indexPairs[srcFirstIndex / 2 + i % CLUSTER_INDEX_PAIRS];
+	}
+	
+	//The base vertex and instance count written by asteroids.cs.glsl are kept
+	if (gl_LocalInvocationIndex == 0) {
+		drawArgs[asteroidIdx * 5 + 0] = numPairs * 2;
+		drawArgs[asteroidIdx * 5 + 2] = dstFirstIndex;
+	}
+}
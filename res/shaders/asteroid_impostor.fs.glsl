@@ -0,0 +1,37 @@
+#include rendersettings.glh
+
+in vec3 quadWorldPos_v;
+in vec2 atlasPos_v;
+flat in vec3 worldDir_v;
+flat in float worldRadius_v;
+flat in float layer_v;
+flat in uint asteroidIdx_v;
+
+out vec4 color_out;
+
+layout(binding=0) uniform sampler2DArray impostorAlbedoAndAO;
+layout(binding=1) uniform sampler2DArray impostorNormalDepth;
+layout(binding=2) uniform sampler2DArrayShadow shadowMap;
+
+#include lighting.glh
+#include asteroid_impostor.glh
+#include asteroid_rotation.glh
+
+const float specIntensity = 0.2;
+const float specExponent = 20;
+
+void main() {
+	vec4 normalDepth = texture(impostorNormalDepth, vec3(atlasPos_v, layer_v));
+	if (normalDepth.a < 0.5)
+		discard;
+	
+	//The baked depth goes from the front of the bounding sphere at 0 to the back at 1
+	vec3 worldPos = quadWorldPos_v + worldDir_v * (1 - 2 * normalDepth.b) * worldRadius_v;
+	vec3 worldNormal = normalize(getRotation(asteroidIdx_v) * octDecode(normalDepth.rg * 2 - 1));
+	vec4 diffuseAndAO = texture(impostorAlbedoAndAO, vec3(atlasPos_v, layer_v));
+	
+	vec4 clipPos = rs.vpMatrix * vec4(worldPos, 1);
+	gl_FragDepth = (clipPos.z / clipPos.w) * 0.5 + 0.5;
+	
+	color_out = vec4(calculateLighting(worldPos, worldNormal, diffuseAndAO, specIntensity, specExponent), 0);
+}
@@ -0,0 +1,50 @@
+#include rendersettings.glh
+#include asteroid_impostor.glh
+#include asteroid_rotation.glh
+
+layout(binding=0, std430) readonly buffer AsteroidTransformsTSBuf {
+	vec4 transformTS[];
+};
+
+#define ASTEROID_SETTINGS_BINDING 2
+#include asteroid_settings.glh
+
+//Written by asteroids.cs.glsl, the draw arguments are followed by the index of each asteroid to draw as an impostor
+layout(binding=3, std430) readonly buffer ImpostorListBuf {
+	uint impostorDrawArgs[4];
+	uint impostorAsteroids[];
+};
+
+uniform uint verticesPerVariant;
+
+out vec3 quadWorldPos_v;
+out vec2 atlasPos_v;
+flat out vec3 worldDir_v;
+flat out float worldRadius_v;
+flat out float layer_v;
+flat out uint asteroidIdx_v;
+
+const vec2 corners[] = vec2[] (vec2(-1, -1), vec2(1, -1), vec2(1, 1), vec2(-1, -1), vec2(1, 1), vec2(-1, 1));
+
+void main() {
+	uint asteroidIdx = impostorAsteroids[gl_InstanceID];
+	vec4 transform = transformTS[asteroidIdx];
+	mat3 rotation = getRotation(asteroidIdx);
+	
+	//The frame baked closest to the view direction is used, with the quad aligned to that frame rather than the camera
+	vec3 localDirToCamera = normalize(transpose(rotation) * (rs.cameraPos - transform.xyz));
+	uvec2 frame = getImpostorFrame(localDirToCamera);
+	vec3 dir = getImpostorFrameDir(frame);
+	vec3 right, up;
+	getImpostorBasis(dir, right, up);
+	
+	vec2 corner = corners[gl_VertexID];
+	worldRadius_v = asteroidSettings[asteroidIdx].radius * unpackUnorm2x16(floatBitsToUint(transform.w)).x;
+	worldDir_v = rotation * dir;
+	quadWorldPos_v = transform.xyz + rotation * (right * corner.x + up * corner.y) * worldRadius_v;
+	atlasPos_v = (vec2(frame) + corner * 0.5 + 0.5) / float(IMPOSTOR_FRAMES);
+	layer_v = float(asteroidSettings[asteroidIdx].firstVertex / verticesPerVariant);
+	asteroidIdx_v = asteroidIdx;
+	
+	gl_Position = rs.vpMatrix * vec4(quadWorldPos_v, 1);
+}
@@ -0,0 +1,14 @@
+in vec3 normal_v;
+in vec3 texPos_v;
+
+layout(location=0) out vec4 albedoAndAO_out;
+layout(location=1) out vec4 normalDepth_out;
+
+#include asteroid_impostor.glh
+#include asteroid_material.glh
+
+void main() {
+	vec3 localNormal;
+	albedoAndAO_out = sampleAsteroidMaterial(texPos_v, normalize(normal_v), localNormal);
+	normalDepth_out = vec4(octEncode(localNormal) * 0.5 + 0.5, gl_FragCoord.z, 1);
+}
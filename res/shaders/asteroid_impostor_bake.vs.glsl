@@ -0,0 +1,23 @@
+layout(location=0) in vec3 position_in;
+layout(location=2) in vec4 normal_in;
+
+#include asteroid_impostor.glh
+
+layout(location=0) uniform uvec2 frame;
+layout(location=1) uniform float size;
+
+out vec3 normal_v;
+out vec3 texPos_v;
+
+const float textureScale = 0.05;
+
+void main() {
+	vec3 dir = getImpostorFrameDir(frame);
+	vec3 right, up;
+	getImpostorBasis(dir, right, up);
+	
+	//Positions are normalized by the variant size, so the view covers [-1, 1] along every axis
+	normal_v = normal_in.xyz;
+	texPos_v = position_in * size * textureScale;
+	gl_Position = vec4(dot(position_in, right), dot(position_in, up), -dot(position_in, dir), 1);
+}
@@ -0,0 +1,253 @@
+layout(local_size_x=64, local_size_y=1, local_size_z=1) in;
+
+//Places the asteroids of a batch of chunks with phased dart throwing. Chunks are split into cells that are at least
+// half as large as the furthest distance at which two asteroids can conflict, and each dispatch handles one phase,
+// which is every third cell along each axis. Darts in different cells of a phase can't conflict with each other, so
+// every cell gets its own work group. The work group throws one dart per thread and keeps the lowest valid one,
+// this repeats until no dart is valid. With COMPACT defined, the placed asteroids are written to the chunks' slots.
+
+const uint MAX_JOBS = 8;
+const uint NUM_VARIANTS = 50;
+const uint CELL_CAPACITY = 32;
+const uint NO_DART = 0xFFFFFFFFu;
+
+struct PlacedAsteroid {
+	vec4 posAndRadiusAndSpacing;
+	uint variant;
+};
+
+layout(binding=0, std430) coherent buffer CellCountsBuf {
+	uint cellCounts[];
+};
+
+layout(binding=1, std430) coherent buffer CellAsteroidsBuf {
+	PlacedAsteroid cellAsteroids[];
+};
+
+//Chunk coordinate and slot of each chunk in the batch
+uniform ivec4 jobs[MAX_JOBS];
+
+//constant uniforms
+uniform uint worldSeed;
+uniform float chunkSize;
+uniform int cellsPerSide;
+uniform float variantSize[NUM_VARIANTS];
+
+uint hash(uint x) {
+	x ^= x >> 16;
+	x *= 0x7FEB352Du;
+	x ^= x >> 15;
+	x *= 0x846CA68Bu;
+	x ^= x >> 16;
+	return x;
+}
+
+//Same as getChunkSeed in asteroids_gen.cpp
+uint getChunkSeed(ivec3 coord) {
+	return worldSeed ^ (uint(coord.x) * 73856093u) ^ (uint(coord.y) * 19349663u) ^ (uint(coord.z) * 83492791u);
+}
+
+uint rngState;
+
+float randomFloat() {
+	rngState = hash(rngState);
+	return float(rngState >> 8) * (1.0 / 16777216.0);
+}
+
+vec3 randomDirection() {
+	float z = randomFloat() * 2.0 - 1.0;
+	float angle = randomFloat() * 6.2831853;
+	float r = sqrt(max(1.0 - z * z, 0.0));
+	return vec3(r * cos(angle), r * sin(angle), z);
+}
+
+uint getCellIndex(uint job, ivec3 cell) {
+	return job * uint(cellsPerSide * cellsPerSide * cellsPerSide) + uint((cell.x * cellsPerSide + cell.y) * cellsPerSide + cell.z);
+}
+
+#ifdef COMPACT
+
+#define ASTEROID_SETTINGS_BINDING 2
+#define ASTEROID_SETTINGS_ACCESS writeonly
+#include asteroid_settings.glh
+
+//The number of asteroids placed in each chunk of the batch, including those that didn't fit in the slot
+layout(binding=3, std430) writeonly buffer PlacementCountsBuf {
+	uint placementCounts[];
+};
+
+uniform uint variantFirstVertex[NUM_VARIANTS];
+uniform uint asteroidsPerChunk;
+
+shared uint numPlaced;
+
+void main() {
+	uint job = gl_WorkGroupID.x;
+	uint firstAsteroid = uint(jobs[job].w) * asteroidsPerChunk;
+	uint chunkSeed = getChunkSeed(jobs[job].xyz);
+	
+	if (gl_LocalInvocationIndex == 0) {
+		numPlaced = 0;
+	}
+	barrier();
+	
+	uint numCells = uint(cellsPerSide * cellsPerSide * cellsPerSide);
+	for (uint cell = gl_LocalInvocationIndex; cell < numCells; cell += gl_WorkGroupSize.x) {
+		uint cellIdx = job * numCells + cell;
+		for (uint i = 0; i < cellCounts[cellIdx]; i++) {
+			uint idx = atomicAdd(numPlaced, 1u);
+			if (idx >= asteroidsPerChunk)
+				continue;
+			
+			PlacedAsteroid placed = cellAsteroids[cellIdx * CELL_CAPACITY + i];
+			rngState = hash(chunkSeed ^ hash(cell * CELL_CAPACITY + i));
+			
+			AsteroidSettings settings;
+			settings.pos = placed.posAndRadiusAndSpacing.xyz;
+			settings.radius = variantSize[placed.variant];
+			settings.initialRotation = randomFloat() * 6.2831853;
+			settings.rotationSpeed = mix(0.1, 0.4, randomFloat());
+			settings.rotationAxis = packSnorm4x8(vec4(randomDirection(), 0.0));
+			settings.firstVertex = variantFirstVertex[placed.variant];
+			asteroidSettings[firstAsteroid + idx] = settings;
+		}
+	}
+	barrier();
+	
+	//The rest of the slot gets a radius of 0, which isn't drawn
+	for (uint i = min(numPlaced, asteroidsPerChunk) + gl_LocalInvocationIndex; i < asteroidsPerChunk; i += gl_WorkGroupSize.x) {
+		asteroidSettings[firstAsteroid + i] = AsteroidSettings(vec3(0.0), 0.0, 0.0, 0.0, 0u, 0u);
+	}
+	
+	if (gl_LocalInvocationIndex == 0) {
+		placementCounts[job] = numPlaced;
+	}
+}
+
+#else
+
+//per-dispatch uniforms
+uniform ivec3 phase;
+uniform ivec3 phaseCells;
+uniform uint placementRound;
+
+//constant uniforms
+uniform float spacingLo;
+uniform float spacingHi;
+uniform float maxRadiusAndSpacing;
+
+//Darts with a lower index than this are thrown next to an asteroid already in the cell, since that packs them more
+// densely. These are preferred because the lowest valid dart is kept.
+const uint GROWN_DARTS = 48;
+const int MAX_ITERATIONS = 16;
+
+shared uint bestDart;
+
+vec3 gradient(ivec3 corner) {
+	uint h = hash(worldSeed ^ hash(uint(corner.x) ^ hash(uint(corner.y) ^ hash(uint(corner.z)))));
+	float z = float(h & 0xFFFFu) * (2.0 / 65535.0) - 1.0;
+	float angle = float(h >> 16) * (6.2831853 / 65536.0);
+	float r = sqrt(max(1.0 - z * z, 0.0));
+	return vec3(r * cos(angle), r * sin(angle), z);
+}
+
+//The position is in doubles since it's relative to the world origin, only the fraction within a lattice cell is single precision
+float gradientNoise(dvec3 pos) {
+	dvec3 latticeD = floor(pos);
+	ivec3 lattice = ivec3(latticeD);
+	vec3 f = vec3(pos - latticeD);
+	vec3 u = f * f * f * (f * (f * 6.0 - 15.0) + 10.0);
+	
+	float result[2];
+	for (int x = 0; x < 2; x++) {
+		float yz[2];
+		for (int y = 0; y < 2; y++) {
+			float z0 = dot(gradient(lattice + ivec3(x, y, 0)), f - vec3(x, y, 0));
+			float z1 = dot(gradient(lattice + ivec3(x, y, 1)), f - vec3(x, y, 1));
+			yz[y] = mix(z0, z1, u.z);
+		}
+		result[x] = mix(yz[0], yz[1], u.y);
+	}
+	return mix(result[0], result[1], u.x);
+}
+
+//The CPU generator uses two octaves of Perlin noise at the same frequency, lacunarity and persistence
+float spacingNoise(dvec3 pos) {
+	return gradientNoise(pos * 0.01) + gradientNoise(pos * 0.015) * 0.5;
+}
+
+bool anyConflict(uint job, vec3 pos, float radius, float cellSize) {
+	float range = radius + maxRadiusAndSpacing;
+	ivec3 loCell = clamp(ivec3(floor((pos - range) / cellSize)), ivec3(0), ivec3(cellsPerSide - 1));
+	ivec3 hiCell = clamp(ivec3(floor((pos + range) / cellSize)), ivec3(0), ivec3(cellsPerSide - 1));
+	for (int x = loCell.x; x <= hiCell.x; x++) {
+		for (int y = loCell.y; y <= hiCell.y; y++) {
+			for (int z = loCell.z; z <= hiCell.z; z++) {
+				uint cellIdx = getCellIndex(job, ivec3(x, y, z));
+				for (uint i = 0; i < cellCounts[cellIdx]; i++) {
+					vec4 other = cellAsteroids[cellIdx * CELL_CAPACITY + i].posAndRadiusAndSpacing;
+					float minDist = other.w + radius;
+					vec3 toOther = other.xyz - pos;
+					if (dot(toOther, toOther) < minDist * minDist)
+						return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+void main() {
+	uint job = gl_WorkGroupID.y;
+	uint phaseCell = gl_WorkGroupID.x;
+	uvec3 phaseCellsU = uvec3(phaseCells);
+	ivec3 cell = phase + 3 * ivec3(phaseCell / (phaseCellsU.y * phaseCellsU.z), (phaseCell / phaseCellsU.z) % phaseCellsU.y, phaseCell % phaseCellsU.z);
+	float cellSize = chunkSize / float(cellsPerSide);
+	vec3 cellMin = vec3(cell) * cellSize;
+	uint cellIdx = getCellIndex(job, cell);
+	
+	//Seeded from the chunk and the cell within it, so that a chunk is placed the same way in any batch
+	rngState = hash(getChunkSeed(jobs[job].xyz) ^ hash(getCellIndex(0, cell) ^ hash(placementRound ^ hash(gl_LocalInvocationIndex))));
+	
+	for (int iteration = 0; iteration < MAX_ITERATIONS; iteration++) {
+		if (gl_LocalInvocationIndex == 0) {
+			bestDart = NO_DART;
+		}
+		barrier();
+		
+		uint count = cellCounts[cellIdx];
+		uint variant = min(uint(randomFloat() * float(NUM_VARIANTS)), NUM_VARIANTS - 1);
+		float radius = variantSize[variant];
+		vec3 pos;
+		if (count != 0 && gl_LocalInvocationIndex < GROWN_DARTS) {
+			uint parentIdx = min(uint(randomFloat() * float(count)), count - 1);
+			vec4 parent = cellAsteroids[cellIdx * CELL_CAPACITY + parentIdx].posAndRadiusAndSpacing;
+			pos = parent.xyz + randomDirection() * (parent.w + radius);
+		} else {
+			pos = cellMin + vec3(randomFloat(), randomFloat(), randomFloat()) * cellSize;
+		}
+		
+		//Asteroids are kept entirely inside the chunk so that they can't intersect asteroids in neighbouring chunks
+		bool inCell = all(greaterThanEqual(pos, cellMin)) && all(lessThan(pos, cellMin + cellSize));
+		bool inChunk = all(greaterThanEqual(pos, vec3(radius))) && all(lessThanEqual(pos, vec3(chunkSize - radius)));
+		if (count < CELL_CAPACITY && inCell && inChunk && !anyConflict(job, pos, radius, cellSize)) {
+			atomicMin(bestDart, gl_LocalInvocationIndex);
+		}
+		barrier();
+		
+		uint winner = bestDart;
+		if (winner == NO_DART)
+			break;
+		
+		if (gl_LocalInvocationIndex == winner) {
+			dvec3 worldPos = dvec3(jobs[job].xyz) * double(chunkSize) + dvec3(pos);
+			float spacing = mix(spacingLo, spacingHi, clamp(spacingNoise(worldPos) * 0.5 + 0.5, 0.0, 1.0));
+			cellAsteroids[cellIdx * CELL_CAPACITY + count] = PlacedAsteroid(vec4(pos, radius + spacing), variant);
+			cellCounts[cellIdx] = count + 1;
+		}
+		memoryBarrierBuffer();
+		barrier();
+	}
+}
+
+#endif
@@ -1,7 +1,14 @@
 #extension GL_ARB_shader_draw_parameters : require
 
 layout(location=0) in vec3 position_in;
-layout(location=1) in vec3 lowerLodPos_in;
+layout(location=1) in vec3 lowerLodDelta_in;
+
+#ifdef LAYERED
+//The layered pass draws the draw argument ranges of all cascades in one multi-draw
+#include rendersettings.glh
+layout(location=1) uniform uint numAsteroids;
+#define ASTEROID_INDEX (uint(gl_DrawIDARB) % numAsteroids)
+#endif
 
 #include asteroid_vs.glh
 
@@ -9,5 +16,12 @@ layout(location=0) uniform mat4 shadowMatrix;
 
 void main() {
 	vec3 scaledPos;
-	gl_Position = shadowMatrix * vec4(transformToWorld(position_in, lowerLodPos_in, SHADOW_LOD_BIAS, scaledPos), 1);
+	vec3 worldPos = transformToWorld(position_in, lowerLodDelta_in, SHADOW_LOD_BIAS, scaledPos);
+#ifdef LAYERED
+	uint cascade = uint(gl_DrawIDARB) / numAsteroids;
+	gl_Position = rs.shadowMatrices[cascade] * vec4(worldPos, 1);
+	gl_Layer = int(cascade);
+#else
+	gl_Position = shadowMatrix * vec4(worldPos, 1);
+#endif
 }
@@ -1,17 +1,6 @@
 layout(local_size_x=64, local_size_y=1, local_size_z=1) in;
 
-struct AsteroidSettings {
-	vec3 pos;
-	float radius;
-	float initialRotation;
-	float rotationSpeed;
-	uint rotationAxis;
-	uint firstVertex;
-};
-
-layout(binding=0, std430) readonly buffer AsteroidSettingsBuf {
-	AsteroidSettings asteroidSettings[];
-};
+#include asteroid_settings.glh
 
 layout(binding=1, std430) writeonly buffer AsteroidTransformsTSBuf {
 	vec4 transformTSOut[];
@@ -25,20 +14,50 @@ layout(binding=3, std430) writeonly buffer AsteroidDrawArgsBuf {
 	uint drawArgsOut[];
 };
 
+layout(binding=5, std430) buffer ShadowCasterBoundsBuf {
+	uint shadowCasterBounds[];
+};
+
+//Asteroids drawn at a clustered lod are appended here so that asteroid_clusters.cs.glsl can cull their clusters
+layout(binding=6, std430) buffer ClusterCullListBuf {
+	uint clusterCullCount;
+	uvec2 clusterCullList[];
+};
+
+//Far asteroids are appended here and drawn as impostors, the instance count of the draw arguments is the list length
+layout(binding=7, std430) buffer ImpostorListBuf {
+	uint impostorDrawArgs[4];
+	uint impostorAsteroids[];
+};
+
+//Chunk coordinates of each slot, asteroids are stored in consecutive ranges of asteroidsPerChunk per slot
+layout(binding=1, std140) uniform ChunkCoordsUB {
+	ivec4 chunkCoords[1024];
+};
+
 #include rendersettings.glh
 #include asteroid_lod.glh
+#include asteroid_visibility.glh
 
 //per-frame uniforms
-uniform vec3 wrappingOffset;
-uniform vec3 globalOffset;
+uniform ivec3 originChunk;
 uniform vec4 frustumPlanes[6];
 uniform vec4 frustumPlanesShadow[4 * NUM_SHADOW_CASCADES];
+uniform float shadowTexelSize[NUM_SHADOW_CASCADES];
+uniform uint shadowCasterBoundsOffset;
+uniform uint shadowRedrawMask;
 
 //constant uniforms
 uniform uint numAsteroids;
-uniform float wrappingModulo;
+uniform float chunkSize;
+uniform uint asteroidsPerChunk;
+uniform float streamRadius;
 uniform float distancePerLod;
 uniform float globalLodBias;
+uniform bool occlusionCulling;
+uniform uint clusterCullMinLod;
+uniform uint maxClusterCullAsteroids;
+uniform float impostorDistance;
 uniform uint lodVertexOffsets[NUM_LOD_LEVELS];
 uniform uint lodFirstIndex[NUM_LOD_LEVELS];
 uniform uint lodNumIndices[NUM_LOD_LEVELS];
@@ -46,47 +65,75 @@ uniform uint lodNumIndices[NUM_LOD_LEVELS];
 const float SCALE_FADE_BEGIN = 0.9;
 const float LOD_FADE_LEN = 0.1;
 
-void main() {
-	uint asteroidIdx = gl_GlobalInvocationID.x;
-	if (asteroidIdx > numAsteroids)
-		return;
-	
-	vec3 posNoGlobalOffset = mod(asteroidSettings[asteroidIdx].pos + wrappingOffset, vec3(wrappingModulo));
-	vec3 pos = posNoGlobalOffset + globalOffset;
+//Min and max caster depth for each cascade, reduced in shared memory before being written to shadowCasterBounds
+shared uint groupCasterBounds[NUM_SHADOW_CASCADES * 2];
+
+//Maps float bits to uints with the same ordering, so that atomicMin and atomicMax can be used
+uint orderedFloatBits(float x) {
+	uint bits = floatBitsToUint(x);
+	return (bits & 0x80000000u) != 0 ? ~bits : (bits | 0x80000000u);
+}
+
+void processAsteroid(uint asteroidIdx) {
+	ivec3 chunkOffset = chunkCoords[asteroidIdx / asteroidsPerChunk].xyz - originChunk;
+	vec3 pos = asteroidSettings[asteroidIdx].pos + vec3(chunkOffset) * chunkSize;
 	
-	vec3 distToWrapEdge3 = abs(posNoGlobalOffset - vec3(wrappingModulo / 2));
-	float distToWrapEdge = max(max(distToWrapEdge3.x, distToWrapEdge3.y), distToWrapEdge3.z) / (wrappingModulo / 2);
-	float scale = 1 - clamp((distToWrapEdge - SCALE_FADE_BEGIN) / (1 - SCALE_FADE_BEGIN), 0.0, 1.0);
+	//Asteroids shrink away towards the edge of the streamed area, unused entries have no radius
+	float distToEdge = distance(rs.cameraPos, pos);
+	float scale = 1 - clamp((distToEdge / streamRadius - SCALE_FADE_BEGIN) / (1 - SCALE_FADE_BEGIN), 0.0, 1.0);
+	if (asteroidSettings[asteroidIdx].radius == 0)
+		scale = 0;
 	
 	uint drawArgsIdx = asteroidIdx * 5;
 	uint drawArgsStride = numAsteroids * 5;
 	
 	//Lod
-	float distToEdge = distance(rs.cameraPos, pos);
 	float lodF = getLodLevelF(distToEdge, distancePerLod) + globalLodBias;
 	int lodLevel = getLodLevelI(lodF, NORMAL_LOD_BIAS);
 	
 	//Frustum culling
-	drawArgsOut[drawArgsIdx + 1] = 1;
+	bool inFrustum = scale > 0;
 	for (int i = 0; i < 6; i++) {
 		if (dot(vec4(pos, 1), frustumPlanes[i]) < -asteroidSettings[asteroidIdx].radius) {
-			drawArgsOut[drawArgsIdx + 1] = 0;
+			inFrustum = false;
 		}
 	}
 	
-	//Frustum culling for shadow mapping
+	bool impostor = distToEdge > impostorDistance;
+	if (impostor && inFrustum) {
+		impostorAsteroids[atomicAdd(impostorDrawArgs[1], 1)] = asteroidIdx;
+	}
+	
+	//Only asteroids that were visible last frame are drawn in the first pass,
+	// the rest are tested against the depth pyramid in asteroids_occlusion.cs.glsl.
+	uint visibilityFlags = visibility[asteroidIdx];
+	bool visibleLastFrame = !occlusionCulling || (visibilityFlags & VIS_VISIBLE) != 0;
+	drawArgsOut[drawArgsIdx + 1] = (inFrustum && visibleLastFrame && !impostor) ? 1 : 0;
+	visibility[asteroidIdx] = (visibilityFlags & VIS_VISIBLE) | (inFrustum ? VIS_IN_FRUSTUM : 0u);
+	
+	//Frustum culling for shadow mapping, asteroids covering less than one texel in a cascade are also culled
+	float shadowRadius = asteroidSettings[asteroidIdx].radius * scale;
 	for (uint cascade = 0; cascade < NUM_SHADOW_CASCADES; cascade++) {
-		uint enable = 1;
+		uint enable = 2 * shadowRadius < shadowTexelSize[cascade] ? 0 : 1;
 		for (int i = 0; i < 4; i++) {
 			if (dot(vec4(pos, 1), frustumPlanesShadow[cascade * 4 + i]) < -asteroidSettings[asteroidIdx].radius) {
 				enable = 0;
 			}
 		}
-		drawArgsOut[drawArgsStride * (cascade + 1) + drawArgsIdx + 1] = enable;
+		
+		//Cached cascades which aren't redrawn this frame get no instances, so that the layered pass skips them
+		bool redraw = (shadowRedrawMask & (1u << cascade)) != 0;
+		drawArgsOut[drawArgsStride * (cascade + 1) + drawArgsIdx + 1] = redraw ? enable : 0u;
+		
+		if (enable == 1) {
+			float depth = dot(rs.sunDir, pos);
+			atomicMin(groupCasterBounds[cascade * 2 + 0], orderedFloatBits(depth - asteroidSettings[asteroidIdx].radius));
+			atomicMax(groupCasterBounds[cascade * 2 + 1], orderedFloatBits(depth + asteroidSettings[asteroidIdx].radius));
+		}
 	}
 	
-	//Writes draw arguments
-	uint daNumIndices = lodNumIndices[lodLevel];
+	//Writes draw arguments, impostors get no indices so that the second occlusion culling pass doesn't draw them either
+	uint daNumIndices = impostor ? 0 : lodNumIndices[lodLevel];
 	uint daFirstIndex = lodFirstIndex[lodLevel];
 	uint dafirstVertex = asteroidSettings[asteroidIdx].firstVertex + lodVertexOffsets[lodLevel];
 	drawArgsOut[drawArgsIdx + 0] = daNumIndices;
@@ -94,14 +141,22 @@ void main() {
 	drawArgsOut[drawArgsIdx + 3] = dafirstVertex;
 	drawArgsOut[drawArgsIdx + 4] = 0;
 	
-	uint lodLevelShadow = getLodLevelI(lodF, SHADOW_LOD_BIAS);
-	daNumIndices = lodNumIndices[lodLevelShadow];
-	daFirstIndex = lodFirstIndex[lodLevelShadow];
-	dafirstVertex = asteroidSettings[asteroidIdx].firstVertex + lodVertexOffsets[lodLevelShadow];
+	//If the list is full the asteroid is drawn whole
+	if (inFrustum && !impostor && uint(lodLevel) >= clusterCullMinLod) {
+		uint slot = atomicAdd(clusterCullCount, 1);
+		if (slot < maxClusterCullAsteroids) {
+			clusterCullList[slot] = uvec2(asteroidIdx, lodLevel);
+		}
+	}
+	
+	//The shadow lod is never higher than what the camera distance would give,
+	// but is lowered further in cascades where the texels are large.
+	int lodLevelShadow = getLodLevelI(lodF, SHADOW_LOD_BIAS);
 	for (uint i = 1; i <= NUM_SHADOW_CASCADES; i++) {
-		drawArgsOut[drawArgsIdx + i * drawArgsStride + 0] = daNumIndices;
-		drawArgsOut[drawArgsIdx + i * drawArgsStride + 2] = daFirstIndex;
-		drawArgsOut[drawArgsIdx + i * drawArgsStride + 3] = dafirstVertex;
+		int cascadeLod = min(lodLevelShadow, getLodLevelForTexelSize(shadowRadius, shadowTexelSize[i - 1]));
+		drawArgsOut[drawArgsIdx + i * drawArgsStride + 0] = lodNumIndices[cascadeLod];
+		drawArgsOut[drawArgsIdx + i * drawArgsStride + 2] = lodFirstIndex[cascadeLod];
+		drawArgsOut[drawArgsIdx + i * drawArgsStride + 3] = asteroidSettings[asteroidIdx].firstVertex + lodVertexOffsets[cascadeLod];
 		drawArgsOut[drawArgsIdx + i * drawArgsStride + 4] = 0;
 	}
 	
@@ -120,3 +175,24 @@ void main() {
 	transformROut[asteroidIdx * 3 + 1] = packSnorm2x16(ry.xy);
 	transformROut[asteroidIdx * 3 + 2] = packSnorm2x16(vec2(rx.z, ry.z));
 }
+
+void main() {
+	if (gl_LocalInvocationIndex < NUM_SHADOW_CASCADES * 2) {
+		groupCasterBounds[gl_LocalInvocationIndex] = (gl_LocalInvocationIndex % 2) == 0 ? 0xFFFFFFFFu : 0u;
+	}
+	barrier();
+	
+	if (gl_GlobalInvocationID.x < numAsteroids) {
+		processAsteroid(gl_GlobalInvocationID.x);
+	}
+	barrier();
+	
+	if (gl_LocalInvocationIndex < NUM_SHADOW_CASCADES * 2) {
+		uint boundsIdx = shadowCasterBoundsOffset + gl_LocalInvocationIndex;
+		if ((gl_LocalInvocationIndex % 2) == 0) {
+			atomicMin(shadowCasterBounds[boundsIdx], groupCasterBounds[gl_LocalInvocationIndex]);
+		} else {
+			atomicMax(shadowCasterBounds[boundsIdx], groupCasterBounds[gl_LocalInvocationIndex]);
+		}
+	}
+}
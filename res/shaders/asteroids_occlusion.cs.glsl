@@ -0,0 +1,99 @@
+layout(local_size_x=64, local_size_y=1, local_size_z=1) in;
+
+#include asteroid_settings.glh
+
+layout(binding=1, std430) readonly buffer AsteroidTransformsTSBuf {
+	vec4 transformTS[];
+};
+
+layout(binding=3, std430) buffer AsteroidDrawArgsBuf {
+	uint drawArgs[];
+};
+
+layout(binding=5, std430) buffer AsteroidCullStatsBuf {
+	uint cullStats[];
+};
+
+#include rendersettings.glh
+#include asteroid_visibility.glh
+
+layout(binding=0) uniform sampler2D depthPyramid;
+
+//per-frame uniforms
+uniform uint cullStatsOffset;
+
+//constant uniforms
+uniform uint numAsteroids;
+uniform uint secondPassFirstArg;
+
+bool isOccluded(vec3 center, float radius) {
+	vec2 uvMin = vec2(1);
+	vec2 uvMax = vec2(0);
+	float minDepth = 1;
+	for (int i = 0; i < 8; i++) {
+		vec3 corner = center + radius * vec3((i & 1) != 0 ? 1 : -1, (i & 2) != 0 ? 1 : -1, (i & 4) != 0 ? 1 : -1);
+		vec4 cornerH = rs.vpMatrix * vec4(corner, 1);
+		
+		//The bounding box crosses the near plane, so it can't be occluded
+		if (cornerH.w <= 0 || cornerH.z < -cornerH.w)
+			return false;
+		
+		vec3 cornerNdc = cornerH.xyz / cornerH.w;
+		uvMin = min(uvMin, cornerNdc.xy * 0.5 + 0.5);
+		uvMax = max(uvMax, cornerNdc.xy * 0.5 + 0.5);
+		minDepth = min(minDepth, cornerNdc.z * 0.5 + 0.5);
+	}
+	
+	uvMin = clamp(uvMin, vec2(0), vec2(1)) * rs.renderScale;
+	uvMax = clamp(uvMax, vec2(0), vec2(1)) * rs.renderScale;
+	
+	//Selects the pyramid level where the bounding rectangle covers at most 2x2 texels
+	vec2 extent = (uvMax - uvMin) * vec2(textureSize(depthPyramid, 0));
+	int lod = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), 0, textureQueryLevels(depthPyramid) - 1);
+	
+	ivec2 levelSize = textureSize(depthPyramid, lod);
+	ivec2 texelMin = clamp(ivec2(uvMin * vec2(levelSize)), ivec2(0), levelSize - 1);
+	ivec2 texelMax = clamp(ivec2(uvMax * vec2(levelSize)), ivec2(0), levelSize - 1);
+	
+	float maxDepth = 0;
+	for (int y = texelMin.y; y <= texelMax.y; y++) {
+		for (int x = texelMin.x; x <= texelMax.x; x++) {
+			maxDepth = max(maxDepth, texelFetch(depthPyramid, ivec2(x, y), lod).r);
+		}
+	}
+	
+	return minDepth > maxDepth;
+}
+
+void main() {
+	uint asteroidIdx = gl_GlobalInvocationID.x;
+	if (asteroidIdx >= numAsteroids)
+		return;
+	
+	uint firstPassArgsIdx = asteroidIdx * 5;
+	uint drawArgsIdx = secondPassFirstArg + asteroidIdx * 5;
+	
+	uint visibilityFlags = visibility[asteroidIdx];
+	bool visible = false;
+	if ((visibilityFlags & VIS_IN_FRUSTUM) != 0) {
+		atomicAdd(cullStats[cullStatsOffset + 0], 1);
+		visible = !isOccluded(transformTS[asteroidIdx].xyz, asteroidSettings[asteroidIdx].radius);
+		if (!visible) {
+			atomicAdd(cullStats[cullStatsOffset + 1], 1);
+		}
+	}
+	
+	//Asteroids which were drawn in the first pass don't need to be drawn again
+	bool drawInSecondPass = visible && drawArgs[firstPassArgsIdx + 1] == 0;
+	if (drawInSecondPass) {
+		atomicAdd(cullStats[cullStatsOffset + 2], 1);
+	}
+	
+	drawArgs[drawArgsIdx + 0] = drawArgs[firstPassArgsIdx + 0];
+	drawArgs[drawArgsIdx + 1] = drawInSecondPass ? 1 : 0;
+	drawArgs[drawArgsIdx + 2] = drawArgs[firstPassArgsIdx + 2];
+	drawArgs[drawArgsIdx + 3] = drawArgs[firstPassArgsIdx + 3];
+	drawArgs[drawArgsIdx + 4] = drawArgs[firstPassArgsIdx + 4];
+	
+	visibility[asteroidIdx] = (visibilityFlags & VIS_IN_FRUSTUM) | (visible ? VIS_VISIBLE : 0u);
+}
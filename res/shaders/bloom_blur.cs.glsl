@@ -0,0 +1,61 @@
+layout(local_size_x=16, local_size_y=16, local_size_z=1) in;
+
+const int BLOOM_STEPS = 4;
+
+layout(binding=0) uniform sampler2D levelsIn;
+layout(binding=0, rgba16f) uniform writeonly image2D levelsOut[BLOOM_STEPS];
+
+layout(location=0) uniform float brightnessScale;
+
+#include rendersettings.glh
+
+const float kernel[] = float[] (0.382928, 0.241732, 0.060598, 0.005977, 0.000229);
+
+const int RADIUS = kernel.length() - 1;
+const int TILE_SIZE = 16;
+const int APRON_TILE_SIZE = TILE_SIZE + RADIUS * 2;
+
+shared vec3 inTile[APRON_TILE_SIZE][APRON_TILE_SIZE];
+shared vec3 hBlurTile[APRON_TILE_SIZE][TILE_SIZE];
+
+//Blurs all bloom levels in one dispatch, the z workgroup index selects the level.
+// The dispatch is sized for the largest level, so groups outside the smaller levels do nothing.
+void main() {
+	int level = int(gl_WorkGroupID.z);
+	ivec2 levelSize = ivec2(ceil(vec2(textureSize(levelsIn, level)) * rs.renderScale));
+	ivec2 tileOrigin = ivec2(gl_WorkGroupID.xy) * TILE_SIZE;
+	bool groupActive = tileOrigin.x < levelSize.x && tileOrigin.y < levelSize.y;
+	ivec2 localCoord = ivec2(gl_LocalInvocationID.xy);
+	
+	if (groupActive) {
+		for (int y = localCoord.y; y < APRON_TILE_SIZE; y += TILE_SIZE) {
+			for (int x = localCoord.x; x < APRON_TILE_SIZE; x += TILE_SIZE) {
+				ivec2 srcCoord = clamp(tileOrigin + ivec2(x, y) - RADIUS, ivec2(0), levelSize - 1);
+				inTile[y][x] = texelFetch(levelsIn, srcCoord, level).rgb;
+			}
+		}
+	}
+	
+	barrier();
+	
+	if (groupActive) {
+		for (int y = localCoord.y; y < APRON_TILE_SIZE; y += TILE_SIZE) {
+			vec3 sum = inTile[y][localCoord.x + RADIUS] * kernel[0];
+			for (int i = 1; i <= RADIUS; i++) {
+				sum += (inTile[y][localCoord.x + RADIUS + i] + inTile[y][localCoord.x + RADIUS - i]) * kernel[i];
+			}
+			hBlurTile[y][localCoord.x] = sum;
+		}
+	}
+	
+	barrier();
+	
+	ivec2 coord = tileOrigin + localCoord;
+	if (groupActive && coord.x < levelSize.x && coord.y < levelSize.y) {
+		vec3 sum = hBlurTile[localCoord.y + RADIUS][localCoord.x] * kernel[0];
+		for (int i = 1; i <= RADIUS; i++) {
+			sum += (hBlurTile[localCoord.y + RADIUS + i][localCoord.x] + hBlurTile[localCoord.y + RADIUS - i][localCoord.x]) * kernel[i];
+		}
+		imageStore(levelsOut[level], coord, vec4(sum * brightnessScale, 0));
+	}
+}
@@ -9,12 +9,16 @@ layout(location=1) uniform float brightnessScale;
 
 const float kernel[] = float[] (0.382928, 0.241732, 0.060598, 0.005977, 0.000229);
 
+#include rendersettings.glh
+
 void main() {
-	color_out = texture(texIn, screenCoord_v) * kernel[0];
+	vec2 texCoord = screenCoord_v * rs.renderScale;
+	vec2 texCoordMax = renderedCoordMax(vec2(textureSize(texIn, 0)));
+	color_out = texture(texIn, min(texCoord, texCoordMax)) * kernel[0];
 	
 	for (int i = 1; i < kernel.length(); i++) {
-		color_out += texture(texIn, screenCoord_v + blurVector * i) * kernel[i];
-		color_out += texture(texIn, screenCoord_v - blurVector * i) * kernel[i];
+		color_out += texture(texIn, clamp(texCoord + blurVector * i, vec2(0), texCoordMax)) * kernel[i];
+		color_out += texture(texIn, clamp(texCoord - blurVector * i, vec2(0), texCoordMax)) * kernel[i];
 	}
 	
 	color_out.a = 0;
@@ -0,0 +1,54 @@
+layout(local_size_x=16, local_size_y=16, local_size_z=1) in;
+
+const int BLOOM_STEPS = 4;
+
+layout(binding=0) uniform sampler2D texIn;
+layout(binding=0, rgba16f) uniform writeonly image2D levelsOut[BLOOM_STEPS];
+
+layout(location=0) uniform float minBrightness;
+
+#include rendersettings.glh
+
+//Each workgroup reduces a 32x32 tile of the input to 16x16, 8x8, 4x4 and 2x2 texels
+// in the bloom levels, keeping the intermediate levels in shared memory.
+shared vec3 tile[16][16];
+
+void main() {
+	ivec2 localCoord = ivec2(gl_LocalInvocationID.xy);
+	ivec2 coord = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 inMax = ivec2(vec2(textureSize(texIn, 0)) * rs.renderScale) - 1;
+	
+	ivec2 srcCoord = coord * 2;
+	vec3 color = (
+		texelFetch(texIn, min(srcCoord, inMax), 0).rgb +
+		texelFetch(texIn, min(srcCoord + ivec2(1, 0), inMax), 0).rgb +
+		texelFetch(texIn, min(srcCoord + ivec2(0, 1), inMax), 0).rgb +
+		texelFetch(texIn, min(srcCoord + ivec2(1, 1), inMax), 0).rgb) * 0.25;
+	color = max(color - minBrightness, vec3(0));
+	
+	if (all(lessThan(coord, imageSize(levelsOut[0])))) {
+		imageStore(levelsOut[0], coord, vec4(color, 0));
+	}
+	tile[localCoord.y][localCoord.x] = color;
+	
+	for (int level = 1; level < BLOOM_STEPS; level++) {
+		barrier();
+		
+		int levelTileSize = 16 >> level;
+		bool levelActive = localCoord.x < levelTileSize && localCoord.y < levelTileSize;
+		if (levelActive) {
+			ivec2 s = localCoord * 2;
+			color = (tile[s.y][s.x] + tile[s.y][s.x + 1] + tile[s.y + 1][s.x] + tile[s.y + 1][s.x + 1]) * 0.25;
+		}
+		
+		barrier();
+		
+		if (levelActive) {
+			tile[localCoord.y][localCoord.x] = color;
+			ivec2 levelCoord = ivec2(gl_WorkGroupID.xy) * levelTileSize + localCoord;
+			if (all(lessThan(levelCoord, imageSize(levelsOut[level])))) {
+				imageStore(levelsOut[level], levelCoord, vec4(color, 0));
+			}
+		}
+	}
+}
@@ -6,11 +6,16 @@ layout(binding=0) uniform sampler2D texIn;
 
 layout(location=0) uniform float minBrightness;
 
+#include rendersettings.glh
+
 void main() {
+	//The offsets read one texel further, so the lookup is kept another texel inside the rendered area
+	vec2 texSize = vec2(textureSize(texIn, 0));
+	vec2 texCoord = min(screenCoord_v * rs.renderScale, max(renderedCoordMax(texSize) - 1.0 / texSize, 0.5 / texSize));
 	color_out =
-		textureOffset(texIn, screenCoord_v, ivec2(0, 0)) +
-		textureOffset(texIn, screenCoord_v, ivec2(0, 1)) +
-		textureOffset(texIn, screenCoord_v, ivec2(1, 0)) +
-		textureOffset(texIn, screenCoord_v, ivec2(1, 1));
+		textureOffset(texIn, texCoord, ivec2(0, 0)) +
+		textureOffset(texIn, texCoord, ivec2(0, 1)) +
+		textureOffset(texIn, texCoord, ivec2(1, 0)) +
+		textureOffset(texIn, texCoord, ivec2(1, 1));
 	color_out = max(color_out * 0.25 - minBrightness, vec4(0));
 }
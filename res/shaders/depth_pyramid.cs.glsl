@@ -0,0 +1,28 @@
+layout(local_size_x=8, local_size_y=8, local_size_z=1) in;
+
+layout(binding=0) uniform sampler2D srcDepth;
+layout(binding=0, r32f) uniform writeonly image2D dstLevel;
+
+layout(location=0) uniform int srcLod;
+
+void main() {
+	ivec2 dstSize = imageSize(dstLevel);
+	ivec2 dstCoord = ivec2(gl_GlobalInvocationID.xy);
+	if (dstCoord.x >= dstSize.x || dstCoord.y >= dstSize.y)
+		return;
+	
+	//Each destination texel covers up to 3x3 source texels when the source size is odd,
+	// the maximum is taken so that the pyramid stays conservative.
+	ivec2 srcSize = textureSize(srcDepth, srcLod);
+	ivec2 srcMin = (dstCoord * srcSize) / dstSize;
+	ivec2 srcMax = min(((dstCoord + 1) * srcSize + dstSize - 1) / dstSize, srcSize) - 1;
+	
+	float depth = 0;
+	for (int y = srcMin.y; y <= srcMax.y; y++) {
+		for (int x = srcMin.x; x <= srcMax.x; x++) {
+			depth = max(depth, texelFetch(srcDepth, ivec2(x, y), srcLod).r);
+		}
+	}
+	
+	imageStore(dstLevel, dstCoord, vec4(depth));
+}
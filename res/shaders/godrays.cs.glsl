@@ -0,0 +1,56 @@
+layout(local_size_x=8, local_size_y=8, local_size_z=1) in;
+
+layout(binding=0) uniform sampler2D maskSampler;
+layout(binding=1) uniform sampler2D depthSampler;
+layout(binding=0, rg16f) uniform writeonly image2D godRaysOut;
+
+#include rendersettings.glh
+
+const uint grSampleCount = 50;
+const float grLightDecay = pow(0.00004, 1.0 / float(grSampleCount));
+const float grSunRadius = 15;
+const float grBrightness = 5;
+
+//Radial blur of the sky mask towards the sun, same as the full resolution version that used to be in post.fs.glsl
+float calcGodRays(vec2 screenCoord) {
+	vec4 ssPosPps = rs.vpMatrix * vec4(-rs.sunDir, 0);
+	if (ssPosPps.z < 0)
+		return 0;
+	vec2 sunScreenPosition = (ssPosPps.xy / ssPosPps.w) * 0.5 + 0.5;
+	
+	const float viewSize = 700;
+	
+	vec2 texSize = textureSize(maskSampler, 0);
+	vec2 coordMul = vec2(viewSize, viewSize * (texSize.y / texSize.x));
+	
+	float distToLight = distance(screenCoord * coordMul, sunScreenPosition * coordMul);
+	float lightBeginSample = max(1.0 - (grSunRadius / max(distToLight, 0.0001)), 0.0) * grSampleCount;
+	
+	float illuminationDecay = pow(grLightDecay, floor(lightBeginSample) + 1);
+	
+	float light = 0.0;
+	vec2 maskCoordMax = renderedCoordMax(texSize);
+	for (uint i = uint(ceil(lightBeginSample)); i < grSampleCount; i++) {
+		vec2 sampleCoord = mix(screenCoord, sunScreenPosition, float(i) / float(grSampleCount));
+		light += textureLod(maskSampler, min(clamp(sampleCoord, vec2(0), vec2(1)) * rs.renderScale, maskCoordMax), 0).r * illuminationDecay;
+		illuminationDecay *= grLightDecay;
+	}
+	
+	return light * grBrightness;
+}
+
+void main() {
+	ivec2 coord = ivec2(gl_GlobalInvocationID.xy);
+	vec2 outSize = vec2(imageSize(godRaysOut)) * rs.renderScale;
+	if (coord.x >= ceil(outSize.x) || coord.y >= ceil(outSize.y))
+		return;
+	
+	vec2 screenCoord = (vec2(coord) + 0.5) / outSize;
+	
+	//The distance to the camera is stored alongside so that the post shader can upsample with depth awareness
+	float depthH = texelFetch(depthSampler, min(coord * 2, textureSize(depthSampler, 0) - 1), 0).r;
+	vec4 worldPos = rs.vpMatrixInv * vec4(screenCoord * 2 - 1, depthH * 2 - 1, 1);
+	float dist = distance(worldPos.xyz / worldPos.w, rs.cameraPos);
+	
+	imageStore(godRaysOut, coord, vec4(calcGodRays(screenCoord), dist, 0, 0));
+}
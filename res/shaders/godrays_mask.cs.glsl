@@ -0,0 +1,24 @@
+layout(local_size_x=8, local_size_y=8, local_size_z=1) in;
+
+layout(binding=0) uniform sampler2D depthSampler;
+layout(binding=0, r8) uniform writeonly image2D maskOut;
+
+//Fraction of the 2x2 full resolution texels under each mask texel that see the sky
+void main() {
+	ivec2 coord = ivec2(gl_GlobalInvocationID.xy);
+	if (any(greaterThanEqual(coord, imageSize(maskOut))))
+		return;
+	
+	ivec2 depthMax = textureSize(depthSampler, 0) - 1;
+	float mask = 0;
+	for (int y = 0; y < 2; y++) {
+		for (int x = 0; x < 2; x++) {
+			float depth = texelFetch(depthSampler, min(coord * 2 + ivec2(x, y), depthMax), 0).r;
+			if (depth > 0.99995) {
+				mask += 0.25;
+			}
+		}
+	}
+	
+	imageStore(maskOut, coord, vec4(mask));
+}
@@ -4,6 +4,8 @@ out vec4 color_out;
 
 layout(binding=0) uniform sampler2D texIn;
 layout(binding=1) uniform sampler2D depthSampler;
+layout(binding=3) uniform sampler2D bloomSampler;
+layout(binding=4) uniform sampler2D godRaysSampler;
 
 const float exposure = 1;
 
@@ -11,38 +13,26 @@ const float exposure = 1;
 #include rendersettings.glh
 #include lighting.glh
 
-const uint grSampleCount = 50;
-const float grLightDecay = pow(0.00004, 1.0 / float(grSampleCount));
-const float grSunRadius = 15;
-const float grBrightness = 5;
-
-float calcGodRays() {
-	vec4 ssPosPps = rs.vpMatrix * vec4(-rs.sunDir, 0);
-	if (ssPosPps.z < 0)
-		return 0;
-	vec2 sunScreenPosition = (ssPosPps.xy / ssPosPps.w) * 0.5 + 0.5;
-	
-	const float viewSize = 700;
-	
-	vec2 texSize = textureSize(depthSampler, 0);
-	vec2 coordMul = vec2(viewSize, viewSize * (texSize.y / texSize.x));;
-	
-	float distToLight = distance(screenCoord_v * coordMul, sunScreenPosition * coordMul);
-	float lightBeginSample = max(1.0 - (grSunRadius / max(distToLight, 0.0001)), 0.0) * grSampleCount;
-	
-	float illuminationDecay = pow(grLightDecay, floor(lightBeginSample) + 1);
+//Upsamples the half resolution god rays, weighting the four nearest texels by how close their distance is to this pixel's
+float upsampleGodRays(float pixelDist) {
+	ivec2 lowResSize = textureSize(godRaysSampler, 0);
+	ivec2 lowResMax = ivec2(ceil(vec2(lowResSize) * rs.renderScale)) - 1;
+	vec2 lowResCoord = screenCoord_v * rs.renderScale * vec2(lowResSize) - 0.5;
+	ivec2 baseCoord = ivec2(floor(lowResCoord));
+	vec2 bilinearFract = fract(lowResCoord);
 	
-	float light = 0.0;
-	for (uint i = uint(ceil(lightBeginSample)); i < grSampleCount; i++) {
-		vec2 sampleCoord = mix(screenCoord_v, sunScreenPosition, float(i) / float(grSampleCount));
-		float depth = texture(depthSampler, sampleCoord).r;
-		if (depth > 0.99995) {
-			light += illuminationDecay;
+	float light = 0;
+	float totalWeight = 0;
+	for (int y = 0; y < 2; y++) {
+		for (int x = 0; x < 2; x++) {
+			vec2 godRays = texelFetch(godRaysSampler, clamp(baseCoord + ivec2(x, y), ivec2(0), lowResMax), 0).rg;
+			float bilinearWeight = (x == 0 ? 1 - bilinearFract.x : bilinearFract.x) * (y == 0 ? 1 - bilinearFract.y : bilinearFract.y);
+			float weight = bilinearWeight / (abs(godRays.g - pixelDist) / pixelDist + 0.01);
+			light += godRays.r * weight;
+			totalWeight += weight;
 		}
-		illuminationDecay *= grLightDecay;
 	}
-	
-	return light * grBrightness;
+	return light / max(totalWeight, 0.00001);
 }
 
 vec3 worldPosFromDepth(float depthH) {
@@ -56,18 +46,30 @@ const float FOG_START = 200;
 
 layout(location=0) uniform vec3 vignetteColor;
 layout(location=1) uniform vec3 colorScale;
+layout(location=2) uniform int bloomLevels;
 
 void main() {
-	float depthH = texture(depthSampler, screenCoord_v).r;
+	//The main pass only covers the lower left part of its attachments when rendering at a lower resolution
+	vec2 screenRenderCoord = screenCoord_v * rs.renderScale;
+	vec2 renderCoord = min(screenRenderCoord, renderedCoordMax(vec2(textureSize(texIn, 0))));
+	
+	float depthH = texture(depthSampler, renderCoord).r;
 	vec3 worldPos = worldPosFromDepth(depthH);
 	
-	vec4 color4 = texture(texIn, screenCoord_v);
+	vec4 color4 = texture(texIn, renderCoord);
 	vec3 color = color4.rgb;
 	bool isShip = color4.a == 1;
 	
-	color += calcGodRays() * rs.sunColor;
+	//The compute bloom path leaves its blurred levels to be added here instead of blending them into the main pass
+	for (int i = 0; i < bloomLevels; i++) {
+		vec2 bloomCoord = min(screenRenderCoord, renderedCoordMax(vec2(textureSize(bloomSampler, i))));
+		color += textureLod(bloomSampler, bloomCoord, float(i)).rgb;
+	}
+	
+	float pixelDist = distance(worldPos, rs.cameraPos);
+	color += upsampleGodRays(pixelDist) * rs.sunColor;
 	
-	color = fog(color, distance(worldPos, rs.cameraPos) - FOG_START);
+	color = fog(color, pixelDist - FOG_START);
 	
 	color_out = vec4(vec3(1.0) - exp(-exposure * color), 1.0);
 	
@@ -18,7 +18,7 @@ layout(binding=2) uniform sampler2D targetNoise;
 vec2 screenCoord;
 
 vec3 worldPosFromDepth(float depthH) {
-	vec4 h = vec4(screenCoord * 2 - 1, depthH * 2 - 1, 1);
+	vec4 h = vec4((screenCoord / rs.renderScale) * 2 - 1, depthH * 2 - 1, 1);
 	vec4 d = rs.vpMatrixInv * h;
 	return d.xyz / d.w;
 }
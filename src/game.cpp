@@ -9,12 +9,12 @@
 
 std::mt19937 globalRng(time(nullptr));
 
-glm::vec3 Game::getTargetPosition(float speed) const {
+glm::dvec3 Game::getTargetPosition(float speed) const {
 	float dist = speed * 40;
-	glm::vec3 pos;
+	glm::dvec3 pos;
 	do {
-		pos = ship.pos + dist * randomDirection(globalRng);
-	} while (anyAsteroidIntersects(pos, TARGET_RADIUS));
+		pos = ship.pos + glm::dvec3(dist * randomDirection(globalRng));
+	} while (anyAsteroidIntersects(toRenderSpace(pos), TARGET_RADIUS));
 	return pos;
 }
 
@@ -33,11 +33,11 @@ void Game::newGame() {
 	blueRequiredSpeed = 100;
 	remTime = 60;
 	
-	std::uniform_real_distribution<float> startPosGen(0, ASTEROID_BOX_SIZE);
-	clearAsteroidWrapping();
+	std::uniform_real_distribution<double> startPosGen(0, asteroidBoxSize);
 	do {
-		ship.pos = glm::vec3(startPosGen(globalRng), startPosGen(globalRng), startPosGen(globalRng));
-	} while (anyAsteroidIntersects(ship.pos, 10));
+		ship.pos = glm::dvec3(startPosGen(globalRng), startPosGen(globalRng), startPosGen(globalRng));
+		updateAsteroidChunks(ship.pos, true);
+	} while (anyAsteroidIntersects(toRenderSpace(ship.pos), 10));
 	ship.rollOffset = 0;
 	ship.rollVelocity = 0;
 	ship.vel = glm::vec3(0);
@@ -56,9 +56,8 @@ void Game::runFrame(const InputState& curInput, const InputState& prevInput) {
 	
 	ship.update(curInput, prevInput);
 	
-	glm::vec3 boxPositionOffset = glm::vec3(ship.boxIndex) * ASTEROID_BOX_SIZE;
 	for (Target& target : targets) {
-		target.truePos = target.pos - boxPositionOffset;
+		target.renderPos = toRenderSpace(target.pos);
 	}
 	
 	if (invincibleTime > 0) {
@@ -69,7 +68,7 @@ void Game::runFrame(const InputState& curInput, const InputState& prevInput) {
 	
 	if (!fadingTargets) {
 		for (int t = 0; t < 3; t++) {
-			if (glm::distance(ship.pos, targets[t].truePos) < (TARGET_RADIUS * 1.2f + res::shipModel.sphereRadius)) {
+			if (glm::distance(ship.pos, targets[t].pos) < (TARGET_RADIUS * 1.2f + res::shipModel.sphereRadius)) {
 				targetsAlpha = 1;
 				fadingTargets = true;
 				vignetteColor = targets[t].color * 0.5f;
@@ -94,7 +93,9 @@ void Game::runFrame(const InputState& curInput, const InputState& prevInput) {
 			targets[0].pos = getTargetPosition(std::min(blueRequiredSpeed, 400.0f));
 			targets[1].pos = getTargetPosition(500);
 			targets[2].pos = getTargetPosition(650);
-			ship.boxIndex = glm::ivec3(0);
+			for (Target& target : targets) {
+				target.renderPos = toRenderSpace(target.pos);
+			}
 			remTime = 60;
 			targetsAlpha = 1;
 			fadingTargets = false;
@@ -107,13 +108,13 @@ void Game::runFrame(const InputState& curInput, const InputState& prevInput) {
 void Game::initRenderSettings(uint32_t drawableWidth, uint32_t drawableHeight, RenderSettings& renderSettings) const {
 	glm::vec3 targetPlColor(0);
 	glm::vec3 targetPlPos(0);
-	float closestTargetDist2 = INFINITY;
+	double closestTargetDist2 = INFINITY;
 	for (const Target& target : targets) {
-		float dist2 = glm::distance2(target.truePos, ship.pos);
+		double dist2 = glm::distance2(target.pos, ship.pos);
 		if (dist2 < closestTargetDist2) {
 			closestTargetDist2 = dist2;
 			targetPlColor = target.color * 2.0f * targetsAlpha;
-			targetPlPos = target.truePos;
+			targetPlPos = target.renderPos;
 		}
 	}
 	
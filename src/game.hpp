@@ -32,7 +32,7 @@ struct Game {
 	
 	void initRenderSettings(uint32_t drawableWidth, uint32_t drawableHeight, struct RenderSettings& renderSettings) const;
 	
-	glm::vec3 getTargetPosition(float speed) const;
+	glm::dvec3 getTargetPosition(float speed) const;
 	
 	ColoredStringBuilder buildScoreString();
 };
@@ -3,13 +3,20 @@
 #include "shader.hpp"
 #include "shadows.hpp"
 #include "sphere.hpp"
+#include "asteroids_gen.hpp"
 #include "collision_debug.hpp"
+#include "renderer.hpp"
 #include "../settings.hpp"
 #include "../resources.hpp"
 #include "../utils.hpp"
+#include "../jobs.hpp"
 
+#include <atomic>
 #include <chrono>
+#include <cstring>
+#include <deque>
 #include <iomanip>
+#include <numeric>
 #include <random>
 #include <unordered_map>
 #include <glm/gtc/packing.hpp>
@@ -17,17 +24,36 @@
 
 static_assert(NUM_SPHERE_LODS >= ASTEROID_NUM_LOD_LEVELS);
 
+//Positions and lower lod deltas are normalized by the variant size, which is at least the distance from the center
+// to any vertex. The vertex shader scales them back using the asteroid's radius. Rounding moves each component by up to
+// half a step, size / 65534, which for the largest 60m variants is 0.92mm per axis or 1.6mm in 3D. Lower lod positions
+// also get the rounding of the delta, so they can be off by twice that.
 struct AsteroidVertex {
-	glm::vec3 pos;
-	glm::vec3 lowerLodPos;
+	int16_t pos[3];
+	int16_t lowerLodDelta[3];
 	uint32_t normal;
 };
 
-static inline void calculateNormals(std::span<AsteroidVertex> vertices, std::span<const glm::uvec3> triangles) {
+static_assert(sizeof(AsteroidVertex) == 16);
+
+static inline void packSnorm16(int16_t out[3], const glm::vec3& v) {
+	const glm::vec3 clamped = glm::round(glm::clamp(v, -1.0f, 1.0f) * 32767.0f);
+	for (int i = 0; i < 3; i++) {
+		out[i] = (int16_t)clamped[i];
+	}
+}
+
+static inline glm::vec3 unpackSnorm16(const int16_t in[3]) {
+	return glm::max(glm::vec3(in[0], in[1], in[2]) / 32767.0f, -1.0f);
+}
+
+static inline void calculateNormals(std::span<AsteroidVertex> vertices, std::span<const glm::vec3> positions,
+	std::span<const glm::uvec3> triangles) {
+	
 	glm::vec3* normals = (glm::vec3*)std::calloc(1, vertices.size() * sizeof(glm::vec3));
 	for (const glm::uvec3& triangle : triangles) {
-		glm::vec3 d1 = glm::normalize(vertices[triangle.y].pos - vertices[triangle.x].pos);
-		glm::vec3 d2 = glm::normalize(vertices[triangle.z].pos - vertices[triangle.x].pos);
+		glm::vec3 d1 = glm::normalize(positions[triangle.y] - positions[triangle.x]);
+		glm::vec3 d2 = glm::normalize(positions[triangle.z] - positions[triangle.x]);
 		glm::vec3 normal = glm::normalize(glm::cross(d1, d2));
 		for (int i = 0; i < 3; i++) {
 			normals[triangle[i]] += normal;
@@ -44,7 +70,79 @@ static inline void calculateNormals(std::span<AsteroidVertex> vertices, std::spa
 constexpr uint32_t COLLISION_LOD = 4;
 static_assert(COLLISION_LOD < ASTEROID_NUM_LOD_LEVELS);
 
-AsteroidVariant generateSingleAsteroidVariant(std::mt19937& rng, std::vector<AsteroidVertex>& vertices) {
+//Asteroids drawn at this lod or higher are culled per cluster, for at most MAX_CLUSTER_CULL_ASTEROIDS asteroids each frame
+constexpr uint32_t ASTEROID_CLUSTER_MIN_LOD = SPHERE_CLUSTER_MIN_LOD;
+constexpr uint32_t MAX_CLUSTER_CULL_ASTEROIDS = 128;
+static_assert(ASTEROID_CLUSTER_MIN_LOD < ASTEROID_NUM_LOD_LEVELS);
+
+//Asteroids further away than this many lod distances are drawn as impostors.
+// The frame count must match IMPOSTOR_FRAMES in asteroid_impostor.glh.
+constexpr float IMPOSTOR_LOD_DISTANCES = 8;
+constexpr uint32_t IMPOSTOR_FRAMES = 8;
+constexpr uint32_t IMPOSTOR_FRAME_RES = 32;
+constexpr uint32_t IMPOSTOR_ATLAS_RES = IMPOSTOR_FRAMES * IMPOSTOR_FRAME_RES;
+
+//Bounding sphere and normal cone of a cluster of SPHERE_CLUSTER_TRIANGLES triangles, for culling in asteroid_clusters.cs.glsl
+struct ClusterBounds {
+	glm::vec4 sphere;
+	//The cluster is back facing if dot(center - camera, axis) >= cutoff * length(center - camera) + radius
+	glm::vec3 coneAxis;
+	float coneCutoff;
+};
+
+static_assert(sizeof(ClusterBounds) == 32);
+
+//The bounds cover the triangles at both ends of the lod fade
+static ClusterBounds calculateClusterBounds(std::span<const glm::vec3> positions, std::span<const glm::vec3> lowerLodPositions,
+	std::span<const glm::uvec3> triangles) {
+	
+	glm::vec3 center(0.0f);
+	for (const glm::uvec3& triangle : triangles) {
+		for (int i = 0; i < 3; i++) {
+			center += positions[triangle[i]] + lowerLodPositions[triangle[i]];
+		}
+	}
+	center /= (float)(triangles.size() * 6);
+	
+	float radius = 0;
+	glm::vec3 normalSum(0.0f);
+	std::vector<glm::vec3> normals;
+	for (const glm::uvec3& triangle : triangles) {
+		for (std::span<const glm::vec3> pos : { positions, lowerLodPositions }) {
+			for (int i = 0; i < 3; i++) {
+				radius = std::max(radius, glm::distance(pos[triangle[i]], center));
+			}
+			glm::vec3 normal = glm::cross(pos[triangle.y] - pos[triangle.x], pos[triangle.z] - pos[triangle.x]);
+			if (glm::length2(normal) > 1E-12f) {
+				normals.push_back(glm::normalize(normal));
+				normalSum += normals.back();
+			}
+		}
+	}
+	
+	ClusterBounds bounds;
+	bounds.sphere = glm::vec4(center, radius);
+	bounds.coneAxis = glm::length2(normalSum) > 1E-12f ? glm::normalize(normalSum) : glm::vec3(0, 0, 1);
+	
+	float minDot = 1;
+	for (const glm::vec3& normal : normals) {
+		minDot = std::min(minDot, glm::dot(normal, bounds.coneAxis));
+	}
+	
+	//Cones wider than about 84 degrees from the axis are never culled
+	bounds.coneCutoff = minDot <= 0.1f ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+	return bounds;
+}
+
+#ifdef DEBUG
+//Largest distance between a generated position and its quantized version, in world units.
+// Variants are generated in parallel, so this is only updated once per variant.
+static std::atomic<float> maxQuantizationError = 0;
+#endif
+
+AsteroidVariant generateSingleAsteroidVariant(std::mt19937& rng, std::vector<AsteroidVertex>& vertices,
+	std::vector<ClusterBounds>& clusterBounds) {
+	
 	float innerRadius = std::uniform_real_distribution<float>(0.4f, 0.5f)(rng);
 	
 	AsteroidVariant variant;
@@ -73,8 +171,16 @@ AsteroidVariant generateSingleAsteroidVariant(std::mt19937& rng, std::vector<Ast
 	
 	variant.size = size;
 	
+#ifdef DEBUG
+	float variantQuantizationError = 0;
+#endif
+	
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> lowerLodPositions;
 	for (uint32_t lod = 0; lod < ASTEROID_NUM_LOD_LEVELS; lod++) {
 		size_t firstVertex = vertices.size();
+		positions.clear();
+		lowerLodPositions.clear();
 		
 		for (const SphereVertex& vertex : sphereVertices[lod]) {
 			glm::vec3 scaledVertex = vertex.pos * size;
@@ -82,21 +188,49 @@ AsteroidVariant generateSingleAsteroidVariant(std::mt19937& rng, std::vector<Ast
 			float ridgeNoiseValue = (float)ridgeNoise.GetValue(scaledVertex.x, scaledVertex.y, scaledVertex.z) * 0.5f + 0.5f;
 			float radius = glm::mix(innerRadius, 1.0f, noiseValue) * glm::mix(0.8f, 1.0f, ridgeNoiseValue);
 			glm::vec3 pos = scaledVertex * radius;
-			glm::vec3 prevLodPos = pos;
-			if (vertex.prevLodV1 != -1 && vertex.prevLodV2 != -1) {
-				prevLodPos = (
-					vertices.at(firstVertex + vertex.prevLodV1).pos +
-					vertices.at(firstVertex + vertex.prevLodV2).pos) / 2.0f;
-			}
-			vertices.push_back(AsteroidVertex { pos, prevLodPos, 0 });
+			positions.push_back(pos);
 			if (lod == COLLISION_LOD) {
 				variant.collisionVertices.push_back(pos);
 			}
 		}
 		
-		calculateNormals(std::span<AsteroidVertex>(&vertices[firstVertex], vertices.size() - firstVertex), sphereTriangles[lod]);
+		//The sphere vertices are in vertex fetch order, so the parent vertices may come after the child
+		for (size_t i = 0; i < sphereVertices[lod].size(); i++) {
+			const SphereVertex& vertex = sphereVertices[lod][i];
+			glm::vec3 lowerLodPos = positions[i];
+			if (vertex.prevLodV1 != -1 && vertex.prevLodV2 != -1) {
+				lowerLodPos = (positions.at(vertex.prevLodV1) + positions.at(vertex.prevLodV2)) / 2.0f;
+			}
+			lowerLodPositions.push_back(lowerLodPos);
+			
+			AsteroidVertex& asteroidVertex = vertices.emplace_back();
+			packSnorm16(asteroidVertex.pos, positions[i] / size);
+			packSnorm16(asteroidVertex.lowerLodDelta, (lowerLodPos - positions[i]) / size);
+			asteroidVertex.normal = 0;
+			
+#ifdef DEBUG
+			const glm::vec3 decodedPos = unpackSnorm16(asteroidVertex.pos) * size;
+			const glm::vec3 decodedLowerLodPos = decodedPos + unpackSnorm16(asteroidVertex.lowerLodDelta) * size;
+			variantQuantizationError = std::max(variantQuantizationError, glm::distance(decodedPos, positions[i]));
+			variantQuantizationError = std::max(variantQuantizationError, glm::distance(decodedLowerLodPos, lowerLodPos));
+#endif
+		}
+		
+		calculateNormals(std::span<AsteroidVertex>(&vertices[firstVertex], vertices.size() - firstVertex), positions, sphereTriangles[lod]);
+		
+		if (lod >= ASTEROID_CLUSTER_MIN_LOD) {
+			std::span<const glm::uvec3> triangles = sphereTriangles[lod];
+			for (size_t i = 0; i < triangles.size(); i += SPHERE_CLUSTER_TRIANGLES) {
+				clusterBounds.push_back(calculateClusterBounds(positions, lowerLodPositions, triangles.subspan(i, SPHERE_CLUSTER_TRIANGLES)));
+			}
+		}
 	}
 	
+#ifdef DEBUG
+	float prevMaxError = maxQuantizationError;
+	while (prevMaxError < variantQuantizationError && !maxQuantizationError.compare_exchange_weak(prevMaxError, variantQuantizationError)) { }
+#endif
+	
 	return variant;
 }
 
@@ -121,27 +255,92 @@ static GLuint asteroidsSettingsBuffer;
 static GLuint asteroidsTransformTSBuffer;
 static GLuint asteroidsTransformRBuffer;
 static GLuint asteroidsDrawDataBuffer;
+static GLuint asteroidsVisibilityBuffer;
+static GLuint asteroidsCullStatsBuffer;
+static uint32_t* asteroidsCullStatsMemory;
+static GLuint asteroidsCasterBoundsBuffer;
+static uint32_t* asteroidsCasterBoundsMemory;
+//The render origin that the caster bounds in each frame cycle slot were written relative to
+static glm::dvec3 casterBoundsOrigins[renderer::frameCycleLen];
+static GLuint asteroidsClusterBoundsBuffer;
+static GLuint asteroidsClusterCullListBuffer;
+static GLuint asteroidsImpostorListBuffer;
+static GLuint asteroidsChunkCoordsBuffer;
+
+//One layer for every variant
+static GLuint impostorAlbedoTexture;
+static GLuint impostorNormalDepthTexture;
+
+static uint32_t verticesPerVariant;
+static uint32_t clustersPerVariant;
+static uint32_t compactedFirstIndex;
+
+static float chunkSize;
+static float streamRadius;
+static float prefetchRadius;
+static int chunkGridSize;
+static uint32_t asteroidsPerChunk;
+static uint32_t worldSeed;
+static float spacingScale;
+
+//Cells along each side of a chunk and the largest radius plus spacing that an asteroid can have, for asteroid_placement.cs.glsl
+static int placementCellsPerSide;
+static float placementMaxRadiusAndSpacing;
+
+//Chunk coordinates of renderOrigin
+static glm::ivec3 originChunk;
 
 static uint32_t lodLevelFirstIndex[ASTEROID_NUM_LOD_LEVELS];
 static uint32_t lodLevelVertexOffset[ASTEROID_NUM_LOD_LEVELS];
 
 static Shader asteroidComputeShader;
+static Shader asteroidOcclusionShader;
+static Shader asteroidClusterShader;
+static Shader asteroidImpostorShader;
+static Shader asteroidImpostorBakeShader;
 static Shader asteroidShader;
 static Shader asteroidShadowShader;
+static Shader asteroidShadowLayeredShader;
+static Shader asteroidPlacementShader;
+static Shader asteroidPlacementCompactShader;
 
 static uint64_t bytesPerDrawDataRange;
 
 struct {
-	GLuint wrappingOffset;
-	GLuint globalOffset;
+	GLuint originChunk;
 	GLuint frustumPlanes;
 	GLuint frustumPlanesShadow;
+	GLuint shadowTexelSize;
+	GLuint shadowCasterBoundsOffset;
+	GLuint shadowRedrawMask;
 	GLuint globalLodBias;
+	GLuint cullStatsOffset;
+	GLuint clusterFrustumPlanes;
+	GLuint placementJobs;
+	GLuint placementPhase;
+	GLuint placementPhaseCells;
+	GLuint placementRound;
+	GLuint placementCompactJobs;
 } uniformLocs;
 
+//Draw arguments are stored as one range for the main pass, one for each shadow cascade
+// and finally one for asteroids that are drawn in the second pass of occlusion culling.
+constexpr uint32_t SECOND_PASS_DRAW_DATA_RANGE = 1 + NUM_SHADOW_CASCADES;
+constexpr uint32_t NUM_DRAW_DATA_RANGES = SECOND_PASS_DRAW_DATA_RANGE + 1;
+
+constexpr uint32_t CULL_STATS_STRIDE = 4;
+constexpr uint32_t CASTER_BOUNDS_STRIDE = NUM_SHADOW_CASCADES * 2;
+
 uint32_t numAsteroids = 0;
+float asteroidBoxSize = 0;
+
+AsteroidCullStats asteroidCullStats;
+
+static void setAsteroidShaderUniforms();
 
-static void loadAsteroidShaders() {
+static float currentGlobalLodBias = 0;
+
+void loadAsteroidShaders() {
 	asteroidShader.attachStage(GL_VERTEX_SHADER, "asteroid.vs.glsl");
 	asteroidShader.attachStage(GL_FRAGMENT_SHADER, "asteroid.fs.glsl");
 	asteroidShader.link("asteroids");
@@ -149,9 +348,48 @@ static void loadAsteroidShaders() {
 	asteroidShadowShader.attachStage(GL_VERTEX_SHADER, "asteroid_shadow.vs.glsl");
 	asteroidShadowShader.link("asteroids_shadow");
 	
+	if (!shadowLayerExtension.empty()) {
+		std::string layeredCode = "#extension " + std::string(shadowLayerExtension) + " : require\n#define LAYERED\n";
+		asteroidShadowLayeredShader.attachStage(GL_VERTEX_SHADER, "asteroid_shadow.vs.glsl", layeredCode);
+		asteroidShadowLayeredShader.link("asteroids_shadow_layered");
+	}
+	
 	asteroidComputeShader.attachStage(GL_COMPUTE_SHADER, "asteroids.cs.glsl");
 	asteroidComputeShader.link("asteroids_compute");
 	
+	asteroidOcclusionShader.attachStage(GL_COMPUTE_SHADER, "asteroids_occlusion.cs.glsl");
+	asteroidOcclusionShader.link("asteroids_occlusion");
+	
+	asteroidClusterShader.attachStage(GL_COMPUTE_SHADER, "asteroid_clusters.cs.glsl");
+	asteroidClusterShader.link("asteroid_clusters");
+	
+	asteroidImpostorShader.attachStage(GL_VERTEX_SHADER, "asteroid_impostor.vs.glsl");
+	asteroidImpostorShader.attachStage(GL_FRAGMENT_SHADER, "asteroid_impostor.fs.glsl");
+	asteroidImpostorShader.link("asteroid_impostors");
+	
+	asteroidImpostorBakeShader.attachStage(GL_VERTEX_SHADER, "asteroid_impostor_bake.vs.glsl");
+	asteroidImpostorBakeShader.attachStage(GL_FRAGMENT_SHADER, "asteroid_impostor_bake.fs.glsl");
+	asteroidImpostorBakeShader.link("asteroid_impostor_bake");
+	
+	if (settings::gpuAsteroidPlacement) {
+		asteroidPlacementShader.attachStage(GL_COMPUTE_SHADER, "asteroid_placement.cs.glsl");
+		asteroidPlacementShader.link("asteroid_placement");
+		
+		asteroidPlacementCompactShader.attachStage(GL_COMPUTE_SHADER, "asteroid_placement.cs.glsl", "#define COMPACT\n");
+		asteroidPlacementCompactShader.link("asteroid_placement_compact");
+		
+		asteroidPlacementShader.onReload = setAsteroidShaderUniforms;
+		asteroidPlacementCompactShader.onReload = setAsteroidShaderUniforms;
+	}
+	
+	asteroidComputeShader.onReload = setAsteroidShaderUniforms;
+	asteroidOcclusionShader.onReload = setAsteroidShaderUniforms;
+	asteroidClusterShader.onReload = setAsteroidShaderUniforms;
+	asteroidImpostorShader.onReload = setAsteroidShaderUniforms;
+	asteroidShadowLayeredShader.onReload = setAsteroidShaderUniforms;
+}
+
+static void setAsteroidShaderUniforms() {
 	uint32_t lodNumIndices[ASTEROID_NUM_LOD_LEVELS];
 	for (uint32_t i = 0; i < ASTEROID_NUM_LOD_LEVELS; i++) {
 		lodNumIndices[i] = sphereTriangles[i].size() * 3;
@@ -166,17 +404,103 @@ static void loadAsteroidShaders() {
 	glProgramUniform1f(asteroidComputeShader.program,
 		asteroidComputeShader.findUniform("distancePerLod"), (float)settings::lodDist);
 	glProgramUniform1f(asteroidComputeShader.program,
-		asteroidComputeShader.findUniform("wrappingModulo"), ASTEROID_BOX_SIZE);
+		asteroidComputeShader.findUniform("chunkSize"), chunkSize);
+	glProgramUniform1ui(asteroidComputeShader.program,
+		asteroidComputeShader.findUniform("asteroidsPerChunk"), asteroidsPerChunk);
+	glProgramUniform1f(asteroidComputeShader.program,
+		asteroidComputeShader.findUniform("streamRadius"), streamRadius);
 	glProgramUniform1ui(asteroidComputeShader.program,
 		asteroidComputeShader.findUniform("numAsteroids"), numAsteroids);
+	glProgramUniform1i(asteroidComputeShader.program,
+		asteroidComputeShader.findUniform("occlusionCulling"), settings::occlusionCulling);
+	glProgramUniform1ui(asteroidComputeShader.program,
+		asteroidComputeShader.findUniform("clusterCullMinLod"), settings::clusterCulling ? ASTEROID_CLUSTER_MIN_LOD : ASTEROID_NUM_LOD_LEVELS);
+	glProgramUniform1ui(asteroidComputeShader.program,
+		asteroidComputeShader.findUniform("maxClusterCullAsteroids"), MAX_CLUSTER_CULL_ASTEROIDS);
+	glProgramUniform1f(asteroidComputeShader.program,
+		asteroidComputeShader.findUniform("impostorDistance"), settings::impostors ? IMPOSTOR_LOD_DISTANCES * settings::lodDist : INFINITY);
+	
+	glProgramUniform1ui(asteroidImpostorShader.program,
+		asteroidImpostorShader.findUniform("verticesPerVariant"), verticesPerVariant);
+	
+	uint32_t lodFirstCluster[ASTEROID_NUM_LOD_LEVELS] = { };
+	uint32_t lodNumClusters[ASTEROID_NUM_LOD_LEVELS] = { };
+	for (uint32_t i = ASTEROID_CLUSTER_MIN_LOD; i < ASTEROID_NUM_LOD_LEVELS; i++) {
+		lodNumClusters[i] = sphereTriangles[i].size() / SPHERE_CLUSTER_TRIANGLES;
+		if (i + 1 < ASTEROID_NUM_LOD_LEVELS) {
+			lodFirstCluster[i + 1] = lodFirstCluster[i] + lodNumClusters[i];
+		}
+	}
+	
+	glProgramUniform1uiv(asteroidClusterShader.program,
+		asteroidClusterShader.findUniform("lodFirstIndex"), ASTEROID_NUM_LOD_LEVELS, lodLevelFirstIndex);
+	glProgramUniform1uiv(asteroidClusterShader.program,
+		asteroidClusterShader.findUniform("lodFirstCluster"), ASTEROID_NUM_LOD_LEVELS, lodFirstCluster);
+	glProgramUniform1uiv(asteroidClusterShader.program,
+		asteroidClusterShader.findUniform("lodNumClusters"), ASTEROID_NUM_LOD_LEVELS, lodNumClusters);
+	glProgramUniform1ui(asteroidClusterShader.program,
+		asteroidClusterShader.findUniform("clustersPerVariant"), clustersPerVariant);
+	glProgramUniform1ui(asteroidClusterShader.program,
+		asteroidClusterShader.findUniform("verticesPerVariant"), verticesPerVariant);
+	glProgramUniform1ui(asteroidClusterShader.program,
+		asteroidClusterShader.findUniform("compactedFirstIndex"), compactedFirstIndex);
+	glProgramUniform1ui(asteroidClusterShader.program,
+		asteroidClusterShader.findUniform("compactedIndicesPerSlot"), lodNumIndices[ASTEROID_NUM_LOD_LEVELS - 1]);
+	
+	glProgramUniform1ui(asteroidOcclusionShader.program,
+		asteroidOcclusionShader.findUniform("numAsteroids"), numAsteroids);
+	if (!shadowLayerExtension.empty()) {
+		glProgramUniform1ui(asteroidShadowLayeredShader.program, 1, numAsteroids);
+	}
+	glProgramUniform1ui(asteroidOcclusionShader.program,
+		asteroidOcclusionShader.findUniform("secondPassFirstArg"), numAsteroids * 5 * SECOND_PASS_DRAW_DATA_RANGE);
+	
+	if (settings::gpuAsteroidPlacement) {
+		float variantSizes[ASTEROID_NUM_VARIANTS];
+		uint32_t variantFirstVertices[ASTEROID_NUM_VARIANTS];
+		for (uint32_t i = 0; i < ASTEROID_NUM_VARIANTS; i++) {
+			variantSizes[i] = asteroidVariants[i].size;
+			variantFirstVertices[i] = asteroidVariants[i].firstLodFirstVertex;
+		}
+		
+		for (const Shader* shader : { &asteroidPlacementShader, &asteroidPlacementCompactShader }) {
+			glProgramUniform1ui(shader->program, shader->findUniform("worldSeed"), worldSeed);
+			glProgramUniform1i(shader->program, shader->findUniform("cellsPerSide"), placementCellsPerSide);
+			glProgramUniform1fv(shader->program, shader->findUniform("variantSize"), ASTEROID_NUM_VARIANTS, variantSizes);
+		}
+		
+		glProgramUniform1f(asteroidPlacementShader.program,
+			asteroidPlacementShader.findUniform("chunkSize"), chunkSize);
+		glProgramUniform1f(asteroidPlacementShader.program,
+			asteroidPlacementShader.findUniform("spacingLo"), ASTEROID_SPACING_LO * spacingScale);
+		glProgramUniform1f(asteroidPlacementShader.program,
+			asteroidPlacementShader.findUniform("spacingHi"), ASTEROID_SPACING_HI * spacingScale);
+		glProgramUniform1f(asteroidPlacementShader.program,
+			asteroidPlacementShader.findUniform("maxRadiusAndSpacing"), placementMaxRadiusAndSpacing);
+		
+		glProgramUniform1uiv(asteroidPlacementCompactShader.program,
+			asteroidPlacementCompactShader.findUniform("variantFirstVertex"), ASTEROID_NUM_VARIANTS, variantFirstVertices);
+		glProgramUniform1ui(asteroidPlacementCompactShader.program,
+			asteroidPlacementCompactShader.findUniform("asteroidsPerChunk"), asteroidsPerChunk);
+		
+		uniformLocs.placementJobs = asteroidPlacementShader.findUniform("jobs");
+		uniformLocs.placementPhase = asteroidPlacementShader.findUniform("phase");
+		uniformLocs.placementPhaseCells = asteroidPlacementShader.findUniform("phaseCells");
+		uniformLocs.placementRound = asteroidPlacementShader.findUniform("placementRound");
+		uniformLocs.placementCompactJobs = asteroidPlacementCompactShader.findUniform("jobs");
+	}
 	
-	uniformLocs.wrappingOffset = asteroidComputeShader.findUniform("wrappingOffset");
-	uniformLocs.globalOffset = asteroidComputeShader.findUniform("globalOffset");
+	uniformLocs.originChunk = asteroidComputeShader.findUniform("originChunk");
 	uniformLocs.frustumPlanes = asteroidComputeShader.findUniform("frustumPlanes");
 	uniformLocs.frustumPlanesShadow = asteroidComputeShader.findUniform("frustumPlanesShadow");
+	uniformLocs.shadowTexelSize = asteroidComputeShader.findUniform("shadowTexelSize");
+	uniformLocs.shadowCasterBoundsOffset = asteroidComputeShader.findUniform("shadowCasterBoundsOffset");
+	uniformLocs.shadowRedrawMask = asteroidComputeShader.findUniform("shadowRedrawMask");
 	uniformLocs.globalLodBias = asteroidComputeShader.findUniform("globalLodBias");
+	uniformLocs.cullStatsOffset = asteroidOcclusionShader.findUniform("cullStatsOffset");
+	uniformLocs.clusterFrustumPlanes = asteroidClusterShader.findUniform("frustumPlanes");
 	
-	setGlobalLodBias(0.0f);
+	setGlobalLodBias(currentGlobalLodBias);
 }
 
 struct AsteroidInstance {
@@ -188,18 +512,472 @@ struct AsteroidInstance {
 	uint32_t variant;
 };
 
-std::vector<AsteroidInstance> asteroids;
+//The asteroid field is split into chunks which are generated around the camera on background threads.
+// Every resident chunk has a slot with a range of asteroidsPerChunk asteroids in the GPU buffers, where
+// unused entries have a radius of 0. Slots of chunks that are no longer needed are reused in LRU order.
+struct AsteroidChunk {
+	glm::ivec3 coord;
+	bool used = false;
+	uint64_t lastUsedFrame = 0;
+	std::vector<AsteroidInstance> asteroids;
+	
+	//Set while the asteroids placed on the GPU are being read back, until then the chunk has no collision data
+	bool awaitingPlacement = false;
+	
+	//The asteroids overlapping each cell are gridAsteroids[gridCellOffsets[cell]] to gridAsteroids[gridCellOffsets[cell + 1]]
+	std::vector<uint32_t> gridCellOffsets;
+	std::vector<uint32_t> gridAsteroids;
+};
+
+struct ChunkCoordHash {
+	size_t operator()(const glm::ivec3& coord) const {
+		return getChunkSeed(0, coord);
+	}
+};
 
+//Size of ChunkCoordsUB in asteroids.cs.glsl
+constexpr uint32_t MAX_ASTEROID_CHUNK_SLOTS = 1024;
+constexpr uint32_t MAX_CHUNK_UPLOADS_PER_FRAME = 8;
 constexpr float ASTEROIDS_CELL_SIZE = 50;
-constexpr int ASTEROIDS_GRID_SIZE = ASTEROID_BOX_SIZE / ASTEROIDS_CELL_SIZE;
-std::vector<uint32_t> asteroidGrid[ASTEROIDS_GRID_SIZE][ASTEROIDS_GRID_SIZE][ASTEROIDS_GRID_SIZE];
 
-std::vector<std::pair<glm::vec3, uint32_t>> generateAsteroids(uint32_t seed);
+static std::vector<AsteroidChunk> chunkSlots;
+static std::unordered_map<glm::ivec3, uint32_t, ChunkCoordHash> residentChunks;
+static std::vector<GeneratedChunk> generatedChunks;
+static uint64_t chunkFrameIndex = 0;
 
-void initializeAsteroids() {
-	lodLevelVertexOffset[0] = 0;
+//Offsets from the camera's chunk to the chunks that can be within prefetchRadius of the camera, nearest first
+static std::vector<glm::ivec3> chunkWindowOffsets;
+
+struct WorldSizeParams {
+	float boxSize;
+	int chunksPerBox;
+	float spacingScale;
+};
+
+//Indexed by settings::worldSize - 1. The box size is the diameter of the streamed area, the smaller worlds
+// are also a bit sparser. Chunks are kept large enough that asteroid placement doesn't starve at their edges.
+constexpr WorldSizeParams WORLD_SIZES[] = {
+	{ 1500, 3, 1.3f },
+	{ 2500, 5, 1.15f },
+	{ 3000, 6, 1.05f },
+	{ 4000, 8, 1.0f },
+	{ 5000, 8, 1.0f }
+};
+
+static inline glm::vec3 getChunkOrigin(const glm::ivec3& coord) {
+	return glm::vec3(coord - originChunk) * chunkSize;
+}
+
+static AsteroidChunk& assignChunkSlot(const glm::ivec3& coord, uint32_t slot) {
+	AsteroidChunk& chunk = chunkSlots[slot];
+	if (chunk.used) {
+		residentChunks.erase(chunk.coord);
+	}
+	chunk.coord = coord;
+	chunk.used = true;
+	chunk.lastUsedFrame = chunkFrameIndex;
+	chunk.awaitingPlacement = false;
+	residentChunks[chunk.coord] = slot;
+	
+	const glm::ivec4 coord4(chunk.coord, 0);
+	glNamedBufferSubData(asteroidsChunkCoordsBuffer, sizeof(glm::ivec4) * slot, sizeof(glm::ivec4), &coord4);
+	return chunk;
+}
+
+static void buildChunkGrid(AsteroidChunk& chunk) {
+	//Asteroids are entirely inside their chunk, so the cell ranges only need clamping for rounding
+	const float cellSize = chunkSize / (float)chunkGridSize;
+	auto iterateCells = [&] (const AsteroidInstance& asteroid, const auto& callback) {
+		glm::ivec3 minCell = glm::clamp(glm::ivec3(glm::floor((asteroid.pos - asteroid.radius) / cellSize)), 0, chunkGridSize - 1);
+		glm::ivec3 maxCell = glm::clamp(glm::ivec3(glm::floor((asteroid.pos + asteroid.radius) / cellSize)), 0, chunkGridSize - 1);
+		for (int cx = minCell.x; cx <= maxCell.x; cx++) {
+			for (int cy = minCell.y; cy <= maxCell.y; cy++) {
+				for (int cz = minCell.z; cz <= maxCell.z; cz++) {
+					callback((cx * chunkGridSize + cy) * chunkGridSize + cz);
+				}
+			}
+		}
+	};
+	
+	chunk.gridCellOffsets.assign(chunkGridSize * chunkGridSize * chunkGridSize + 1, 0);
+	for (const AsteroidInstance& asteroid : chunk.asteroids) {
+		iterateCells(asteroid, [&] (int cell) { chunk.gridCellOffsets[cell + 1]++; });
+	}
+	for (size_t i = 1; i < chunk.gridCellOffsets.size(); i++) {
+		chunk.gridCellOffsets[i] += chunk.gridCellOffsets[i - 1];
+	}
+	chunk.gridAsteroids.resize(chunk.gridCellOffsets.back());
+	std::vector<uint32_t> cellFill(chunk.gridCellOffsets.begin(), chunk.gridCellOffsets.end() - 1);
+	for (uint32_t i = 0; i < chunk.asteroids.size(); i++) {
+		iterateCells(chunk.asteroids[i], [&] (int cell) { chunk.gridAsteroids[cellFill[cell]++] = i; });
+	}
+}
+
+static void uploadChunk(GeneratedChunk& generated, uint32_t slot) {
+	AsteroidChunk& chunk = assignChunkSlot(generated.coord, slot);
+	
+	if (generated.asteroids.size() > asteroidsPerChunk) {
+		std::cerr << "chunk " << chunk.coord.x << ", " << chunk.coord.y << ", " << chunk.coord.z << " has " << generated.asteroids.size()
+			<< " asteroids but slots only fit " << asteroidsPerChunk << std::endl;
+		generated.asteroids.resize(asteroidsPerChunk);
+	}
+	
+	std::mt19937 rng(getChunkSeed(worldSeed + 1, chunk.coord));
+	std::vector<AsteroidSettings> asteroidSettings(asteroidsPerChunk, AsteroidSettings { });
+	chunk.asteroids.resize(generated.asteroids.size());
+	for (size_t i = 0; i < generated.asteroids.size(); i++) {
+		glm::vec3 rotationAxis = randomDirection(rng);
+		
+		auto [pos, variant] = generated.asteroids[i];
+		AsteroidSettings& st = asteroidSettings[i];
+		st.firstVertex = asteroidVariants[variant].firstLodFirstVertex;
+		st.scale = asteroidVariants[variant].size;
+		st.initialRotation = std::uniform_real_distribution<float>(0, (float)M_PI * 2)(rng);
+		st.rotationSpeed = std::uniform_real_distribution<float>(0.1f, 0.4f)(rng);
+		st.rotationAxis = glm::packSnorm4x8(glm::vec4(rotationAxis, 0.0f));
+		st.pos = pos;
+		
+		chunk.asteroids[i].pos = pos;
+		chunk.asteroids[i].radius = asteroidVariants[variant].size;
+		chunk.asteroids[i].variant = variant;
+		chunk.asteroids[i].initialRotation = st.initialRotation;
+		chunk.asteroids[i].rotationSpeed = st.rotationSpeed;
+		chunk.asteroids[i].rotationAxis = glm::normalize(glm::unpackSnorm4x8(st.rotationAxis));
+	}
+	buildChunkGrid(chunk);
+	
+	glNamedBufferSubData(asteroidsSettingsBuffer, sizeof(AsteroidSettings) * asteroidsPerChunk * slot,
+		sizeof(AsteroidSettings) * asteroidsPerChunk, asteroidSettings.data());
+}
+
+//Gets a free slot, or the least recently used one if it wasn't used this frame
+static bool findChunkSlot(uint32_t& slotOut) {
+	uint64_t oldestFrame = chunkFrameIndex;
+	bool found = false;
+	for (uint32_t slot = 0; slot < chunkSlots.size(); slot++) {
+		if (!chunkSlots[slot].used) {
+			slotOut = slot;
+			return true;
+		}
+		if (chunkSlots[slot].lastUsedFrame < oldestFrame) {
+			oldestFrame = chunkSlots[slot].lastUsedFrame;
+			slotOut = slot;
+			found = true;
+		}
+	}
+	return found;
+}
+
+static float distanceToChunk(const glm::vec3& cameraPos, const glm::ivec3& coord) {
+	const glm::vec3 chunkMin = getChunkOrigin(coord);
+	const glm::vec3 closest = glm::clamp(cameraPos, chunkMin, chunkMin + chunkSize);
+	return glm::distance(cameraPos, closest);
+}
+
+//With settings::gpuAsteroidPlacement, chunks are placed by asteroid_placement.cs.glsl straight into their slots in
+// asteroidsSettingsBuffer. A batch of chunks is placed per dispatch and its slots are copied to a mapped buffer,
+// which is read once the batch's fence has signaled to fill in the collision data.
+struct PlacementJob {
+	glm::ivec3 coord;
+	uint32_t slot;
+};
+
+struct PlacementBatch {
+	GLsync fence;
+	uint32_t readbackIndex;
+	std::vector<PlacementJob> jobs;
+};
+
+//Sizes of jobs and cells in asteroid_placement.cs.glsl
+constexpr uint32_t MAX_PLACEMENT_JOBS = 8;
+constexpr uint32_t PLACEMENT_CELL_CAPACITY = 32;
+
+//Layout of PlacedAsteroid in asteroid_placement.cs.glsl, the position is relative to the chunk
+struct PlacedAsteroid {
+	glm::vec4 posAndRadiusAndSpacing;
+	uint32_t variant;
+	uint32_t padding[3];
+};
+static_assert(sizeof(PlacedAsteroid) == 32);
+
+//Each round visits every cell once, later rounds fill the gaps left by darts that landed outside their cell
+constexpr uint32_t PLACEMENT_ROUNDS = 2;
+
+//Batches in flight, there is a range of readback memory for each
+constexpr uint32_t MAX_PLACEMENT_BATCHES = renderer::frameCycleLen + 1;
+
+static_assert(MAX_CHUNK_UPLOADS_PER_FRAME <= MAX_PLACEMENT_JOBS);
+
+static GLuint placementCellCountsBuffer;
+static GLuint placementCellAsteroidsBuffer;
+static GLuint placementCountsBuffer;
+static GLuint placementReadbackBuffer;
+static const char* placementReadbackMemory;
+static uint64_t placementReadbackJobBytes;
+
+static std::deque<PlacementBatch> placementBatches;
+static uint32_t numPlacementBatches = 0;
+
+//Reads back the oldest batch, returns false if it hasn't finished and wait isn't set
+static bool finishPlacementBatch(bool wait) {
+	PlacementBatch& batch = placementBatches.front();
+	GLenum status = glClientWaitSync(batch.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? UINT64_MAX : 0);
+	if (status == GL_TIMEOUT_EXPIRED)
+		return false;
+	glDeleteSync(batch.fence);
+	
+	for (size_t i = 0; i < batch.jobs.size(); i++) {
+		//The slot may have been given to another chunk while the batch was in flight
+		AsteroidChunk& chunk = chunkSlots[batch.jobs[i].slot];
+		if (!chunk.used || !chunk.awaitingPlacement || !(chunk.coord == batch.jobs[i].coord))
+			continue;
+		
+		//Each job's range starts with the number of asteroids placed, padded to the size of the settings that follow
+		const char* readback = placementReadbackMemory + (batch.readbackIndex * MAX_PLACEMENT_JOBS + i) * placementReadbackJobBytes;
+		uint32_t numPlaced;
+		std::memcpy(&numPlaced, readback, sizeof(uint32_t));
+		if (numPlaced > asteroidsPerChunk) {
+			std::cerr << "chunk " << chunk.coord.x << ", " << chunk.coord.y << ", " << chunk.coord.z << " has " << numPlaced
+				<< " asteroids placed on the gpu but slots only fit " << asteroidsPerChunk << std::endl;
+			numPlaced = asteroidsPerChunk;
+		}
+		
+		chunk.asteroids.resize(numPlaced);
+		for (uint32_t a = 0; a < numPlaced; a++) {
+			AsteroidSettings st;
+			std::memcpy(&st, readback + sizeof(AsteroidSettings) * (a + 1), sizeof(AsteroidSettings));
+			chunk.asteroids[a].pos = st.pos;
+			chunk.asteroids[a].radius = st.scale;
+			chunk.asteroids[a].variant = st.firstVertex / verticesPerVariant;
+			chunk.asteroids[a].initialRotation = st.initialRotation;
+			chunk.asteroids[a].rotationSpeed = st.rotationSpeed;
+			chunk.asteroids[a].rotationAxis = glm::normalize(glm::unpackSnorm4x8(st.rotationAxis));
+		}
+		buildChunkGrid(chunk);
+		chunk.awaitingPlacement = false;
+	}
+	
+	placementBatches.pop_front();
+	return true;
+}
+
+//Fills the cells of each job without writing them to the chunks' slots
+static void placeInCells(const glm::ivec4* jobUniforms, uint32_t numJobs) {
+	const uint32_t cellsPerChunk = placementCellsPerSide * placementCellsPerSide * placementCellsPerSide;
+	glClearNamedBufferSubData(placementCellCountsBuffer, GL_R32UI, 0, sizeof(uint32_t) * cellsPerChunk * numJobs,
+		GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, placementCellCountsBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, placementCellAsteroidsBuffer);
+	
+	asteroidPlacementShader.use();
+	glUniform4iv(uniformLocs.placementJobs, numJobs, (const GLint*)jobUniforms);
+	for (uint32_t round = 0; round < PLACEMENT_ROUNDS; round++) {
+		glUniform1ui(uniformLocs.placementRound, round);
+		
+		//Cells in the same phase are three cells apart along every axis
+		for (int phase = 0; phase < 27; phase++) {
+			const glm::ivec3 phaseOffset(phase / 9, phase / 3 % 3, phase % 3);
+			const glm::ivec3 phaseCells = (glm::ivec3(placementCellsPerSide + 2) - phaseOffset) / 3;
+			const uint32_t numPhaseCells = phaseCells.x * phaseCells.y * phaseCells.z;
+			if (numPhaseCells == 0)
+				continue;
+			
+			glUniform3iv(uniformLocs.placementPhase, 1, (const GLint*)&phaseOffset);
+			glUniform3iv(uniformLocs.placementPhaseCells, 1, (const GLint*)&phaseCells);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+			glDispatchCompute(numPhaseCells, numJobs, 1);
+		}
+	}
+}
+
+static void dispatchPlacementBatch(std::vector<PlacementJob> jobs) {
+	if (placementBatches.size() == MAX_PLACEMENT_BATCHES) {
+		finishPlacementBatch(true);
+	}
+	
+	glm::ivec4 jobUniforms[MAX_PLACEMENT_JOBS];
+	for (size_t i = 0; i < jobs.size(); i++) {
+		jobUniforms[i] = glm::ivec4(jobs[i].coord, jobs[i].slot);
+	}
+	placeInCells(jobUniforms, jobs.size());
 	
-	std::vector<uint16_t> asteroidIndices;
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, asteroidsSettingsBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, placementCountsBuffer);
+	
+	asteroidPlacementCompactShader.use();
+	glUniform4iv(uniformLocs.placementCompactJobs, jobs.size(), (const GLint*)jobUniforms);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	glDispatchCompute(jobs.size(), 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+	
+	const uint32_t readbackIndex = numPlacementBatches++ % MAX_PLACEMENT_BATCHES;
+	for (size_t i = 0; i < jobs.size(); i++) {
+		const uint64_t readbackOffset = (readbackIndex * MAX_PLACEMENT_JOBS + i) * placementReadbackJobBytes;
+		glCopyNamedBufferSubData(placementCountsBuffer, placementReadbackBuffer, sizeof(uint32_t) * i, readbackOffset, sizeof(uint32_t));
+		glCopyNamedBufferSubData(asteroidsSettingsBuffer, placementReadbackBuffer, sizeof(AsteroidSettings) * asteroidsPerChunk * jobs[i].slot,
+			readbackOffset + sizeof(AsteroidSettings), sizeof(AsteroidSettings) * asteroidsPerChunk);
+	}
+	
+	placementBatches.push_back(PlacementBatch { glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), readbackIndex, std::move(jobs) });
+}
+
+//Places the chunks nearest the origin and returns the most asteroids placed in one of them, to size the slots.
+// The slots aren't allocated yet, so only the cells are filled and their counts are read back.
+static uint32_t measurePlacedAsteroids() {
+	const uint32_t numJobs = std::min((uint32_t)chunkWindowOffsets.size(), MAX_PLACEMENT_JOBS);
+	glm::ivec4 jobUniforms[MAX_PLACEMENT_JOBS];
+	for (uint32_t i = 0; i < numJobs; i++) {
+		jobUniforms[i] = glm::ivec4(chunkWindowOffsets[i], 0);
+	}
+	placeInCells(jobUniforms, numJobs);
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	
+	const uint32_t cellsPerChunk = placementCellsPerSide * placementCellsPerSide * placementCellsPerSide;
+	std::vector<uint32_t> cellCounts(cellsPerChunk * numJobs);
+	glGetNamedBufferSubData(placementCellCountsBuffer, 0, sizeof(uint32_t) * cellCounts.size(), cellCounts.data());
+	
+	uint32_t maxPlaced = 0;
+	for (uint32_t i = 0; i < numJobs; i++) {
+		maxPlaced = std::max(maxPlaced, std::accumulate(cellCounts.begin() + cellsPerChunk * i, cellCounts.begin() + cellsPerChunk * (i + 1), 0U));
+	}
+	return maxPlaced;
+}
+
+//Places a chunk that isn't resident without giving it a slot and reads back its asteroids, so that collisions with it
+// match how it's placed once it's streamed in
+static GeneratedChunk placeChunkForReadback(const glm::ivec3& coord) {
+	const glm::ivec4 jobUniform(coord, 0);
+	placeInCells(&jobUniform, 1);
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	
+	const uint32_t cellsPerChunk = placementCellsPerSide * placementCellsPerSide * placementCellsPerSide;
+	std::vector<uint32_t> cellCounts(cellsPerChunk);
+	glGetNamedBufferSubData(placementCellCountsBuffer, 0, sizeof(uint32_t) * cellsPerChunk, cellCounts.data());
+	std::vector<PlacedAsteroid> cellAsteroids(cellsPerChunk * PLACEMENT_CELL_CAPACITY);
+	glGetNamedBufferSubData(placementCellAsteroidsBuffer, 0, sizeof(PlacedAsteroid) * cellAsteroids.size(), cellAsteroids.data());
+	
+	GeneratedChunk chunk = { coord };
+	for (uint32_t cell = 0; cell < cellsPerChunk; cell++) {
+		for (uint32_t i = 0; i < cellCounts[cell]; i++) {
+			const PlacedAsteroid& placed = cellAsteroids[cell * PLACEMENT_CELL_CAPACITY + i];
+			chunk.asteroids.emplace_back(glm::vec3(placed.posAndRadiusAndSpacing), placed.variant);
+		}
+	}
+	return chunk;
+}
+
+//The chunks are resident as soon as their placement has been dispatched, since draws are ordered after it
+static void placeChunksOnGpu(std::span<const glm::ivec3> coords) {
+	std::vector<PlacementJob> jobs;
+	for (const glm::ivec3& coord : coords) {
+		uint32_t slot;
+		if (!findChunkSlot(slot))
+			break;
+		
+		AsteroidChunk& chunk = assignChunkSlot(coord, slot);
+		chunk.asteroids.clear();
+		buildChunkGrid(chunk);
+		chunk.awaitingPlacement = true;
+		
+		jobs.push_back(PlacementJob { coord, slot });
+		if (jobs.size() == MAX_PLACEMENT_JOBS) {
+			dispatchPlacementBatch(std::move(jobs));
+			jobs.clear();
+		}
+	}
+	if (!jobs.empty()) {
+		dispatchPlacementBatch(std::move(jobs));
+	}
+}
+
+void updateAsteroidChunks(const glm::dvec3& cameraWorldPos, bool waitForChunks) {
+	chunkFrameIndex++;
+	
+	//The origin is kept on a chunk corner so that chunk offsets in render space are exact
+	const glm::ivec3 cameraChunk(glm::floor(cameraWorldPos / (double)chunkSize));
+	originChunk = cameraChunk;
+	renderOrigin = glm::dvec3(originChunk) * (double)chunkSize;
+	const glm::vec3 cameraPos = toRenderSpace(cameraWorldPos);
+	
+	std::vector<glm::ivec3> missingChunks;
+	while (true) {
+		missingChunks.clear();
+		bool missingInStreamRadius = false;
+		for (const glm::ivec3& offset : chunkWindowOffsets) {
+			const glm::ivec3 coord = cameraChunk + offset;
+			const float distance = distanceToChunk(cameraPos, coord);
+			if (distance >= prefetchRadius)
+				continue;
+			
+			auto residentIt = residentChunks.find(coord);
+			if (residentIt != residentChunks.end()) {
+				chunkSlots[residentIt->second].lastUsedFrame = chunkFrameIndex;
+			} else {
+				missingChunks.push_back(coord);
+				missingInStreamRadius |= distance < streamRadius;
+			}
+		}
+		
+		if (settings::gpuAsteroidPlacement) {
+			const size_t maxPlaced = waitForChunks ? missingChunks.size() : MAX_CHUNK_UPLOADS_PER_FRAME;
+			placeChunksOnGpu(std::span(missingChunks).first(std::min(missingChunks.size(), maxPlaced)));
+			
+			//Waiting for chunks also waits for their collision data
+			while (!placementBatches.empty() && finishPlacementBatch(waitForChunks)) { }
+			
+			if (!waitForChunks || !missingInStreamRadius)
+				break;
+			continue;
+		}
+		
+		setChunkGenerationQueue(missingChunks);
+		
+		//Chunks that are already generated don't need to be waited for
+		bool wait = waitForChunks && missingInStreamRadius;
+		for (const glm::ivec3& coord : missingChunks) {
+			if (std::any_of(generatedChunks.begin(), generatedChunks.end(), [&] (const GeneratedChunk& chunk) { return chunk.coord == coord; })) {
+				wait = false;
+			}
+		}
+		takeGeneratedChunks(generatedChunks, wait);
+		
+		//Chunks are uploaded nearest first, the rest stay in generatedChunks until the next frame
+		std::sort(generatedChunks.begin(), generatedChunks.end(), [&] (const GeneratedChunk& a, const GeneratedChunk& b) {
+			return distanceToChunk(cameraPos, a.coord) < distanceToChunk(cameraPos, b.coord);
+		});
+		uint32_t numUploaded = 0;
+		size_t numProcessed = 0;
+		for (; numProcessed < generatedChunks.size(); numProcessed++) {
+			GeneratedChunk& chunk = generatedChunks[numProcessed];
+			if (!waitForChunks && numUploaded == MAX_CHUNK_UPLOADS_PER_FRAME)
+				break;
+			uint32_t slot;
+			if (distanceToChunk(cameraPos, chunk.coord) < prefetchRadius && !residentChunks.contains(chunk.coord) && findChunkSlot(slot)) {
+				uploadChunk(chunk, slot);
+				numUploaded++;
+			}
+		}
+		generatedChunks.erase(generatedChunks.begin(), generatedChunks.begin() + numProcessed);
+		
+		if (!waitForChunks || !missingInStreamRadius)
+			break;
+	}
+}
+
+//Written by the generation job, which is done with them once generationJob is done
+static jobs::Counter generationJob;
+static std::atomic<uint32_t> generationStepsDone = 0;
+static uint32_t generationSteps;
+static std::vector<glm::ivec3> initialChunks;
+static std::vector<uint16_t> asteroidIndices;
+static std::vector<AsteroidVertex> asteroidVertices;
+static std::vector<ClusterBounds> clusterBounds;
+
+static void generateAsteroidData() {
+	generateSphereMeshes();
+	
+	lodLevelVertexOffset[0] = 0;
 	for (uint32_t i = 0; i < ASTEROID_NUM_LOD_LEVELS; i++) {
 		if (i != 0) {
 			lodLevelVertexOffset[i] = lodLevelVertexOffset[i - 1] + sphereVertices[i - 1].size();
@@ -214,26 +992,139 @@ void initializeAsteroids() {
 		}
 	}
 	
-	std::vector<AsteroidVertex> asteroidVertices;
+	//Followed by the ranges that asteroid_clusters.cs.glsl writes compacted indices to, which are copied in pairs so the start is aligned
+	compactedFirstIndex = (asteroidIndices.size() + 1) & ~1U;
+	asteroidIndices.resize(compactedFirstIndex + MAX_CLUSTER_CULL_ASTEROIDS * sphereTriangles[ASTEROID_NUM_LOD_LEVELS - 1].size() * 3, 0);
+	
+	generationStepsDone++;
 	
 #ifdef DEBUG
 	auto varGenStartTime = std::chrono::high_resolution_clock::now();
 #endif
 	
+	//Every variant gets its own seed so that they can be generated in parallel, into separate vectors
 	std::mt19937 rng(42);
+	uint32_t variantSeeds[ASTEROID_NUM_VARIANTS];
+	for (uint32_t& seed : variantSeeds) {
+		seed = rng();
+	}
+	std::vector<AsteroidVertex> variantVertices[ASTEROID_NUM_VARIANTS];
+	std::vector<ClusterBounds> variantClusterBounds[ASTEROID_NUM_VARIANTS];
+	jobs::parallelFor("generate asteroid variant", ASTEROID_NUM_VARIANTS, 1, [&] (uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			std::mt19937 variantRng(variantSeeds[i]);
+			asteroidVariants[i] = generateSingleAsteroidVariant(variantRng, variantVertices[i], variantClusterBounds[i]);
+			generationStepsDone++;
+		}
+	});
+	
+	//All variants have the same number of vertices and clusters, so the variant can be found from the first vertex
+	verticesPerVariant = variantVertices[0].size();
+	clustersPerVariant = variantClusterBounds[0].size();
 	for (uint32_t i = 0; i < ASTEROID_NUM_VARIANTS; i++) {
-		asteroidVariants[i] = generateSingleAsteroidVariant(rng, asteroidVertices);
+		asteroidVariants[i].firstLodFirstVertex = asteroidVertices.size();
+		asteroidVertices.insert(asteroidVertices.end(), variantVertices[i].begin(), variantVertices[i].end());
+		clusterBounds.insert(clusterBounds.end(), variantClusterBounds[i].begin(), variantClusterBounds[i].end());
 	}
 	
 #ifdef DEBUG
 	auto varGenEndTime = std::chrono::high_resolution_clock::now();
 	double varGenElapsed = std::chrono::duration_cast<std::chrono::milliseconds>(varGenEndTime - varGenStartTime).count() / 1000.0;
 	
-	std::cout << "all asteroids use " << asteroidVertices.size() << " vertices and " << asteroidIndices.size() << " indices, "
+	float maxVariantSize = 0;
+	for (const AsteroidVariant& variant : asteroidVariants) {
+		maxVariantSize = std::max(maxVariantSize, variant.size);
+	}
+	const float quantizationErrorBound = 2 * std::sqrt(3.0f) * maxVariantSize / 65534.0f;
+	
+	std::cout << "all asteroids use " << asteroidVertices.size() << " vertices and " << compactedFirstIndex << " indices, "
 		"the highest lod uses " << sphereTriangles[ASTEROID_NUM_LOD_LEVELS - 1].size() << " triangles, "
-		"variant generation took " << std::setprecision(3) << varGenElapsed << "s" << std::endl;
+		"variant generation took " << std::setprecision(3) << varGenElapsed << "s, "
+		"vertex memory is " << asteroidVertices.size() * sizeof(AsteroidVertex) / 1024 << "KiB, "
+		"max quantization error is " << maxQuantizationError * 1000 << "mm, at most " << quantizationErrorBound * 1000 <<
+		"mm for the largest " << maxVariantSize << "m variant" << std::endl;
+#endif
+	
+#ifdef DEBUG
+	auto placeGenStartTime = std::chrono::high_resolution_clock::now();
 #endif
 	
+	//The chunks around the menu camera are generated up front, they also decide how many asteroids a slot has room for
+	worldSeed = rng();
+	startChunkGeneration(worldSeed, chunkSize, spacingScale);
+	generatedChunks.resize(initialChunks.size());
+	jobs::parallelFor("generate chunk", initialChunks.size(), 1, [&] (uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			generatedChunks[i] = generateChunk(initialChunks[i]);
+			generationStepsDone++;
+		}
+	});
+	
+#ifdef DEBUG
+	auto placeGenEndTime = std::chrono::high_resolution_clock::now();
+	double placeGenElapsed = std::chrono::duration_cast<std::chrono::milliseconds>(placeGenEndTime - placeGenStartTime).count() / 1000.0;
+	size_t initialAsteroids = 0;
+	for (const GeneratedChunk& chunk : generatedChunks) {
+		initialAsteroids += chunk.asteroids.size();
+	}
+	std::cout << "generated " << initialAsteroids << " asteroids in " << initialChunks.size() << " chunks of " << chunkSize << "m in "
+		<< placeGenElapsed << "s" << std::endl;
+#endif
+}
+
+void startAsteroidGeneration() {
+	const WorldSizeParams& worldSizeParams = WORLD_SIZES[settings::worldSize - 1];
+	asteroidBoxSize = worldSizeParams.boxSize;
+	chunkSize = asteroidBoxSize / (float)worldSizeParams.chunksPerBox;
+	spacingScale = worldSizeParams.spacingScale;
+	streamRadius = asteroidBoxSize / 2;
+	prefetchRadius = streamRadius + chunkSize / 4;
+	chunkGridSize = (int)std::ceil(chunkSize / ASTEROIDS_CELL_SIZE);
+	
+	//Offsets whose chunk is within prefetchRadius of some point in the camera's chunk
+	const int maxWindowOffset = (int)std::ceil(prefetchRadius / chunkSize) + 1;
+	for (int x = -maxWindowOffset; x <= maxWindowOffset; x++) {
+		for (int y = -maxWindowOffset; y <= maxWindowOffset; y++) {
+			for (int z = -maxWindowOffset; z <= maxWindowOffset; z++) {
+				const glm::vec3 gap = glm::max(glm::abs(glm::vec3(x, y, z)) - 1.0f, 0.0f) * chunkSize;
+				if (glm::length(gap) < prefetchRadius) {
+					chunkWindowOffsets.emplace_back(x, y, z);
+				}
+			}
+		}
+	}
+	std::sort(chunkWindowOffsets.begin(), chunkWindowOffsets.end(), [] (const glm::ivec3& a, const glm::ivec3& b) {
+		return glm::length2(glm::vec3(a)) < glm::length2(glm::vec3(b));
+	});
+	if (chunkWindowOffsets.size() > MAX_ASTEROID_CHUNK_SLOTS) {
+		std::cerr << "too many asteroid chunks for world size " << settings::worldSize << std::endl;
+		std::abort();
+	}
+	
+	//Chunks placed on the GPU are placed once the buffers exist
+	if (!settings::gpuAsteroidPlacement) {
+		for (const glm::ivec3& offset : chunkWindowOffsets) {
+			if (distanceToChunk(glm::vec3(0), offset) < prefetchRadius) {
+				initialChunks.push_back(offset);
+			}
+		}
+	}
+	
+	generationSteps = 1 + ASTEROID_NUM_VARIANTS + initialChunks.size();
+	jobs::run("generate asteroids", generateAsteroidData, &generationJob);
+}
+
+bool isAsteroidGenerationDone() {
+	return generationJob.done();
+}
+
+float asteroidGenerationProgress() {
+	return (float)generationStepsDone / (float)generationSteps;
+}
+
+void initializeAsteroids() {
+	jobs::wait(generationJob);
+	
 	glCreateBuffers(1, &asteroidVertexBuffer);
 	glNamedBufferStorage(asteroidVertexBuffer, asteroidVertices.size() * sizeof(AsteroidVertex), asteroidVertices.data(), 0);
 	
@@ -242,10 +1133,10 @@ void initializeAsteroids() {
 	
 	glCreateVertexArrays(1, &asteroidVao);
 	glEnableVertexArrayAttrib(asteroidVao, 0);
-	glVertexArrayAttribFormat(asteroidVao, 0, 3, GL_FLOAT, false, offsetof(AsteroidVertex, pos));
+	glVertexArrayAttribFormat(asteroidVao, 0, 3, GL_SHORT, true, offsetof(AsteroidVertex, pos));
 	glVertexArrayAttribBinding(asteroidVao, 0, 0);
 	glEnableVertexArrayAttrib(asteroidVao, 1);
-	glVertexArrayAttribFormat(asteroidVao, 1, 3, GL_FLOAT, false, offsetof(AsteroidVertex, lowerLodPos));
+	glVertexArrayAttribFormat(asteroidVao, 1, 3, GL_SHORT, true, offsetof(AsteroidVertex, lowerLodDelta));
 	glVertexArrayAttribBinding(asteroidVao, 1, 0);
 	glEnableVertexArrayAttrib(asteroidVao, 2);
 	glVertexArrayAttribFormat(asteroidVao, 2, 4, GL_INT_2_10_10_10_REV, true, offsetof(AsteroidVertex, normal));
@@ -254,102 +1145,307 @@ void initializeAsteroids() {
 	glVertexArrayVertexBuffer(asteroidVao, 0, asteroidVertexBuffer, 0, sizeof(AsteroidVertex));
 	glVertexArrayElementBuffer(asteroidVao, asteroidIndexBuffer);
 	
-#ifdef DEBUG
-	auto placeGenStartTime = std::chrono::high_resolution_clock::now();
-#endif
+	glCreateBuffers(1, &asteroidsClusterBoundsBuffer);
+	glNamedBufferStorage(asteroidsClusterBoundsBuffer, clusterBounds.size() * sizeof(ClusterBounds), clusterBounds.data(), 0);
 	
-	std::vector<std::pair<glm::vec3, uint32_t>> generatedAsteroids = generateAsteroids(rng());
-	std::vector<AsteroidSettings> asteroidSettings(generatedAsteroids.size());
-	asteroids.resize(generatedAsteroids.size());
-	for (size_t i = 0; i < generatedAsteroids.size(); i++) {
-		glm::vec3 rotationAxis = randomDirection(rng);
-		
-		auto [pos, variant] = generatedAsteroids[i];
-		AsteroidSettings& st = asteroidSettings[i];
-		st.firstVertex = asteroidVariants[variant].firstLodFirstVertex;
-		st.scale = asteroidVariants[variant].size;
-		st.initialRotation = std::uniform_real_distribution<float>(0, (float)M_PI * 2)(rng);
-		st.rotationSpeed = std::uniform_real_distribution<float>(0.1f, 0.4f)(rng);
-		st.rotationAxis = glm::packSnorm4x8(glm::vec4(rotationAxis, 0.0f));
-		st.pos = pos;
+	asteroidVertices = { };
+	asteroidIndices = { };
+	clusterBounds = { };
+	
+	//A count followed by an asteroid index and lod for each slot
+	glCreateBuffers(1, &asteroidsClusterCullListBuffer);
+	glNamedBufferStorage(asteroidsClusterCullListBuffer, sizeof(uint32_t) * 2 * (MAX_CLUSTER_CULL_ASTEROIDS + 1), nullptr, 0);
+	
+	glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &impostorAlbedoTexture);
+	glTextureStorage3D(impostorAlbedoTexture, 1, GL_RGBA8, IMPOSTOR_ATLAS_RES, IMPOSTOR_ATLAS_RES, ASTEROID_NUM_VARIANTS);
+	glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &impostorNormalDepthTexture);
+	glTextureStorage3D(impostorNormalDepthTexture, 1, GL_RGBA8, IMPOSTOR_ATLAS_RES, IMPOSTOR_ATLAS_RES, ASTEROID_NUM_VARIANTS);
+	for (GLuint texture : { impostorAlbedoTexture, impostorNormalDepthTexture }) {
+		glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	
+	uint32_t cellsPerChunk = 0;
+	if (settings::gpuAsteroidPlacement) {
+		//Cells have to be at least half the distance at which two asteroids can conflict, which is the largest
+		// radius plus spacing of the asteroid that is already there plus the largest radius of the new one
+		float maxRadius = 0;
+		for (const AsteroidVariant& variant : asteroidVariants) {
+			maxRadius = std::max(maxRadius, variant.size);
+		}
+		placementMaxRadiusAndSpacing = maxRadius + ASTEROID_SPACING_HI * spacingScale;
+		placementCellsPerSide = std::max((int)(chunkSize / ((placementMaxRadiusAndSpacing + maxRadius) / 2)), 1);
+		cellsPerChunk = placementCellsPerSide * placementCellsPerSide * placementCellsPerSide;
 		
-		asteroids[i].pos = pos;
-		asteroids[i].radius = asteroidVariants[variant].size;
-		asteroids[i].variant = variant;
-		asteroids[i].initialRotation = st.initialRotation;
-		asteroids[i].rotationSpeed = st.rotationSpeed;
-		asteroids[i].rotationAxis = glm::normalize(glm::unpackSnorm4x8(st.rotationAxis));
+		glCreateBuffers(1, &placementCellCountsBuffer);
+		glNamedBufferStorage(placementCellCountsBuffer, sizeof(uint32_t) * cellsPerChunk * MAX_PLACEMENT_JOBS, nullptr, 0);
+		glCreateBuffers(1, &placementCellAsteroidsBuffer);
+		glNamedBufferStorage(placementCellAsteroidsBuffer,
+			sizeof(PlacedAsteroid) * PLACEMENT_CELL_CAPACITY * cellsPerChunk * MAX_PLACEMENT_JOBS, nullptr, 0);
 		
-		glm::ivec3 minCell = glm::ivec3(glm::floor((pos - asteroidVariants[variant].size) / ASTEROIDS_CELL_SIZE)) + ASTEROIDS_GRID_SIZE;
-		glm::ivec3 maxCell = glm::ivec3(glm::floor((pos + asteroidVariants[variant].size) / ASTEROIDS_CELL_SIZE)) + ASTEROIDS_GRID_SIZE;
-		for (int cx = minCell.x; cx <= maxCell.x; cx++) {
-			for (int cy = minCell.y; cy <= maxCell.y; cy++) {
-				for (int cz = minCell.z; cz <= maxCell.z; cz++) {
-					asteroidGrid[cx % ASTEROIDS_GRID_SIZE][cy % ASTEROIDS_GRID_SIZE][cz % ASTEROIDS_GRID_SIZE].push_back(i);
-				}
-			}
+		//The uniforms are set again once the slots are sized
+		finishShaderCompilation();
+		setAsteroidShaderUniforms();
+	}
+	
+	//Slots are sized from the chunks placed so far with some room to spare. GPU placement can't put more
+	// asteroids in a chunk than fit in its cells, so that also bounds them.
+	uint32_t maxChunkAsteroids = 0;
+	if (settings::gpuAsteroidPlacement) {
+		maxChunkAsteroids = measurePlacedAsteroids();
+	} else {
+		for (const GeneratedChunk& chunk : generatedChunks) {
+			maxChunkAsteroids = std::max(maxChunkAsteroids, (uint32_t)chunk.asteroids.size());
 		}
 	}
+	asteroidsPerChunk = roundToNextMul(maxChunkAsteroids * 5 / 4 + 1, 32U);
+	if (settings::gpuAsteroidPlacement) {
+		asteroidsPerChunk = std::min(asteroidsPerChunk, cellsPerChunk * PLACEMENT_CELL_CAPACITY);
+	}
+	
+	//The window holds every chunk that can be needed at once, so the slots beyond that are the LRU cache
+	chunkSlots.resize(chunkWindowOffsets.size());
+	numAsteroids = chunkSlots.size() * asteroidsPerChunk;
 	
 #ifdef DEBUG
-	auto placeGenEndTime = std::chrono::high_resolution_clock::now();
-	double placeGenElapsed = std::chrono::duration_cast<std::chrono::milliseconds>(placeGenEndTime - placeGenStartTime).count() / 1000.0;
-	std::cout << "generated " << asteroidSettings.size() << " asteroids in " << placeGenElapsed << "s" << std::endl;
+	std::cout << chunkSlots.size() << " chunk slots with room for " << asteroidsPerChunk << " asteroids each" << std::endl;
 #endif
 	
 	glCreateBuffers(1, &asteroidsSettingsBuffer);
-	glNamedBufferStorage(asteroidsSettingsBuffer, sizeof(AsteroidSettings) * asteroidSettings.size(), asteroidSettings.data(), 0);
-	numAsteroids = asteroidSettings.size();
+	glNamedBufferStorage(asteroidsSettingsBuffer, sizeof(AsteroidSettings) * numAsteroids, nullptr, GL_DYNAMIC_STORAGE_BIT);
+	glClearNamedBufferSubData(asteroidsSettingsBuffer, GL_R32UI, 0, sizeof(AsteroidSettings) * numAsteroids, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	
+	glCreateBuffers(1, &asteroidsChunkCoordsBuffer);
+	glNamedBufferStorage(asteroidsChunkCoordsBuffer, sizeof(glm::ivec4) * MAX_ASTEROID_CHUNK_SLOTS, nullptr, GL_DYNAMIC_STORAGE_BIT);
+	
+	if (settings::gpuAsteroidPlacement) {
+		glCreateBuffers(1, &placementCountsBuffer);
+		glNamedBufferStorage(placementCountsBuffer, sizeof(uint32_t) * MAX_PLACEMENT_JOBS, nullptr, 0);
+		
+		placementReadbackJobBytes = sizeof(AsteroidSettings) * (asteroidsPerChunk + 1);
+		const uint64_t readbackBytes = placementReadbackJobBytes * MAX_PLACEMENT_JOBS * MAX_PLACEMENT_BATCHES;
+		glCreateBuffers(1, &placementReadbackBuffer);
+		glNamedBufferStorage(placementReadbackBuffer, readbackBytes, nullptr, GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+		placementReadbackMemory = (const char*)glMapNamedBufferRange(placementReadbackBuffer, 0, readbackBytes,
+			GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+		
+#ifdef DEBUG
+		std::cout << "placing asteroids on the gpu in " << cellsPerChunk << " cells per chunk" << std::endl;
+#endif
+	}
 	
 	glCreateBuffers(1, &asteroidsTransformTSBuffer);
 	glNamedBufferStorage(asteroidsTransformTSBuffer, 16 * numAsteroids, nullptr, 0);
 	
+	//Indirect draw arguments for one quad, where the instance count is incremented for every impostor, followed by the impostors' asteroid indices
+	std::vector<uint32_t> initialImpostorList(4 + numAsteroids, 0);
+	initialImpostorList[0] = 6;
+	glCreateBuffers(1, &asteroidsImpostorListBuffer);
+	glNamedBufferStorage(asteroidsImpostorListBuffer, sizeof(uint32_t) * initialImpostorList.size(), initialImpostorList.data(), 0);
+	
 	glCreateBuffers(1, &asteroidsTransformRBuffer);
 	glNamedBufferStorage(asteroidsTransformRBuffer, 12 * numAsteroids, nullptr, 0);
 	
 	bytesPerDrawDataRange = 5 * sizeof(uint32_t) * numAsteroids;
 	glCreateBuffers(1, &asteroidsDrawDataBuffer);
-	glNamedBufferStorage(asteroidsDrawDataBuffer, bytesPerDrawDataRange * (1 + NUM_SHADOW_CASCADES), nullptr, 0);
+	glNamedBufferStorage(asteroidsDrawDataBuffer, bytesPerDrawDataRange * NUM_DRAW_DATA_RANGES, nullptr, 0);
 	
-	loadAsteroidShaders();
+	std::vector<uint32_t> initialVisibility(numAsteroids, 0);
+	glCreateBuffers(1, &asteroidsVisibilityBuffer);
+	glNamedBufferStorage(asteroidsVisibilityBuffer, sizeof(uint32_t) * numAsteroids, initialVisibility.data(), 0);
+	
+	const uint32_t cullStatsBytes = sizeof(uint32_t) * CULL_STATS_STRIDE * renderer::frameCycleLen;
+	std::vector<uint32_t> initialCullStats(CULL_STATS_STRIDE * renderer::frameCycleLen, 0);
+	glCreateBuffers(1, &asteroidsCullStatsBuffer);
+	glNamedBufferStorage(asteroidsCullStatsBuffer, cullStatsBytes, initialCullStats.data(),
+		GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+	asteroidsCullStatsMemory = (uint32_t*)glMapNamedBufferRange(asteroidsCullStatsBuffer, 0, cullStatsBytes,
+		GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+	
+	const uint32_t casterBoundsBytes = sizeof(uint32_t) * CASTER_BOUNDS_STRIDE * renderer::frameCycleLen;
+	std::vector<uint32_t> initialCasterBounds(CASTER_BOUNDS_STRIDE * renderer::frameCycleLen, 0);
+	glCreateBuffers(1, &asteroidsCasterBoundsBuffer);
+	glNamedBufferStorage(asteroidsCasterBoundsBuffer, casterBoundsBytes, initialCasterBounds.data(),
+		GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+	asteroidsCasterBoundsMemory = (uint32_t*)glMapNamedBufferRange(asteroidsCasterBoundsBuffer, 0, casterBoundsBytes,
+		GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+	
+	finishShaderCompilation();
+	setAsteroidShaderUniforms();
+	
+	//Placing chunks on the GPU needs the shaders, so the initial chunks are uploaded last
+	updateAsteroidChunks(glm::dvec3(0.0), true);
 }
 
-static glm::vec3 asteroidWrappingOffset;
-static glm::vec3 asteroidGlobalOffset;
-
-void clearAsteroidWrapping() {
-	asteroidWrappingOffset = glm::vec3(0);
-	asteroidGlobalOffset = glm::vec3(0);
+void bakeAsteroidImpostors() {
+	GLuint depthTexture;
+	glCreateTextures(GL_TEXTURE_2D, 1, &depthTexture);
+	glTextureStorage2D(depthTexture, 1, GL_DEPTH_COMPONENT32F, IMPOSTOR_ATLAS_RES, IMPOSTOR_ATLAS_RES);
+	
+	GLuint framebuffer;
+	glCreateFramebuffers(1, &framebuffer);
+	glNamedFramebufferTexture(framebuffer, GL_DEPTH_ATTACHMENT, depthTexture, 0);
+	const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glNamedFramebufferDrawBuffers(framebuffer, 2, drawBuffers);
+	
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glBindVertexArray(asteroidVao);
+	asteroidImpostorBakeShader.use();
+	res::asteroidAlbedo.bind(0);
+	res::asteroidNormals.bind(1);
+	glDepthMask(1);
+	glEnable(GL_DEPTH_TEST);
+	
+	//Impostors are baked from the most detailed lod
+	constexpr uint32_t BAKE_LOD = ASTEROID_NUM_LOD_LEVELS - 1;
+	const uint32_t numIndices = sphereTriangles[BAKE_LOD].size() * 3;
+	const uintptr_t indicesOffset = lodLevelFirstIndex[BAKE_LOD] * sizeof(uint16_t);
+	
+	for (uint32_t variant = 0; variant < ASTEROID_NUM_VARIANTS; variant++) {
+		glNamedFramebufferTextureLayer(framebuffer, GL_COLOR_ATTACHMENT0, impostorAlbedoTexture, 0, variant);
+		glNamedFramebufferTextureLayer(framebuffer, GL_COLOR_ATTACHMENT1, impostorNormalDepthTexture, 0, variant);
+		
+		//Texels outside the asteroid get zero alpha in the normal and depth texture, which the impostor shader discards
+		const float clearAlbedo[] = { 0, 0, 0, 0 };
+		const float clearNormalDepth[] = { 0.5f, 0.5f, 1, 0 };
+		const float clearDepth = 1;
+		glClearBufferfv(GL_COLOR, 0, clearAlbedo);
+		glClearBufferfv(GL_COLOR, 1, clearNormalDepth);
+		glClearBufferfv(GL_DEPTH, 0, &clearDepth);
+		
+		glUniform1f(1, asteroidVariants[variant].size);
+		const GLint baseVertex = asteroidVariants[variant].firstLodFirstVertex + lodLevelVertexOffset[BAKE_LOD];
+		for (uint32_t y = 0; y < IMPOSTOR_FRAMES; y++) {
+			for (uint32_t x = 0; x < IMPOSTOR_FRAMES; x++) {
+				glViewport(x * IMPOSTOR_FRAME_RES, y * IMPOSTOR_FRAME_RES, IMPOSTOR_FRAME_RES, IMPOSTOR_FRAME_RES);
+				glUniform2ui(0, x, y);
+				glDrawElementsBaseVertex(GL_TRIANGLES, numIndices, GL_UNSIGNED_SHORT, (const void*)indicesOffset, baseVertex);
+			}
+		}
+	}
+	
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &framebuffer);
+	glDeleteTextures(1, &depthTexture);
 }
 
-void updateAsteroidWrapping(const glm::vec3& cameraPos) {
-	glm::vec3 boxOffset = glm::floor(cameraPos / ASTEROID_BOX_SIZE) * ASTEROID_BOX_SIZE;
-	glm::vec3 posInBox = cameraPos - boxOffset;
-	asteroidWrappingOffset = ASTEROID_BOX_SIZE * 1.5f - posInBox;
-	asteroidGlobalOffset = cameraPos - ASTEROID_BOX_SIZE / 2;
+void stopAsteroidStreaming() {
+	stopChunkGeneration();
+	for (const PlacementBatch& batch : placementBatches) {
+		glDeleteSync(batch.fence);
+	}
+	placementBatches.clear();
 }
 
 void setGlobalLodBias(float globalLodBias) {
+	currentGlobalLodBias = globalLodBias;
 	glProgramUniform1f(asteroidComputeShader.program, uniformLocs.globalLodBias, globalLodBias);
 }
 
-void prepareAsteroids(const glm::vec4 frustumPlanes[6], const std::array<glm::vec4, 4>* frustumPlanesShadow) {
+static inline float orderedBitsToFloat(uint32_t bits) {
+	bits = (bits & 0x80000000U) ? (bits & 0x7FFFFFFFU) : ~bits;
+	float value;
+	std::memcpy(&value, &bits, sizeof(float));
+	return value;
+}
+
+void prepareAsteroids(const glm::vec4 frustumPlanes[6], const ShadowMapMatrices& shadowMapMatrices) {
 	constexpr uint32_t COMPUTE_SHADER_LOCAL_SIZE_X = 64;
 	
+	//Reads back the caster depth bounds written frameCycleLen frames ago, like the cull statistics
+	const uint32_t casterBoundsOffset = renderer::frameCycleIndex * CASTER_BOUNDS_STRIDE;
+	for (uint32_t i = 0; i < NUM_SHADOW_CASCADES; i++) {
+		uint32_t minBits = asteroidsCasterBoundsMemory[casterBoundsOffset + i * 2 + 0];
+		uint32_t maxBits = asteroidsCasterBoundsMemory[casterBoundsOffset + i * 2 + 1];
+		if (minBits > maxBits) {
+			shadowCasterDepthBounds[i] = glm::vec2(INFINITY, -INFINITY);
+		} else {
+			const float originShift = glm::dot(SUN_DIR, glm::vec3(renderOrigin - casterBoundsOrigins[renderer::frameCycleIndex]));
+			shadowCasterDepthBounds[i] = glm::vec2(orderedBitsToFloat(minBits), orderedBitsToFloat(maxBits)) - originShift;
+		}
+	}
+	casterBoundsOrigins[renderer::frameCycleIndex] = renderOrigin;
+	const uint32_t clearCasterBounds[2] = { UINT32_MAX, 0 };
+	glClearNamedBufferSubData(asteroidsCasterBoundsBuffer, GL_RG32UI, casterBoundsOffset * sizeof(uint32_t),
+		CASTER_BOUNDS_STRIDE * sizeof(uint32_t), GL_RG_INTEGER, GL_UNSIGNED_INT, clearCasterBounds);
+	
 	asteroidComputeShader.use();
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, asteroidsSettingsBuffer);
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, asteroidsTransformTSBuffer);
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, asteroidsTransformRBuffer);
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, asteroidsDrawDataBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, asteroidsVisibilityBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, asteroidsCasterBoundsBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, asteroidsClusterCullListBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, asteroidsImpostorListBuffer);
+	glBindBufferBase(GL_UNIFORM_BUFFER, 1, asteroidsChunkCoordsBuffer);
+	
+	glClearNamedBufferSubData(asteroidsClusterCullListBuffer, GL_R32UI, 0, sizeof(uint32_t), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	glClearNamedBufferSubData(asteroidsImpostorListBuffer, GL_R32UI, sizeof(uint32_t), sizeof(uint32_t), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
 	
-	static_assert(sizeof(*frustumPlanesShadow) == sizeof(glm::vec4) * 4);
+	static_assert(sizeof(shadowMapMatrices.frustumPlanes[0]) == sizeof(glm::vec4) * 4);
 	
-	glUniform3fv(uniformLocs.wrappingOffset, 1, (float*)&asteroidWrappingOffset);
-	glUniform3fv(uniformLocs.globalOffset, 1, (float*)&asteroidGlobalOffset);
+	glUniform3iv(uniformLocs.originChunk, 1, (const GLint*)&originChunk);
 	glUniform4fv(uniformLocs.frustumPlanes, 6, (const float*)frustumPlanes);
-	glUniform4fv(uniformLocs.frustumPlanesShadow, 4 * NUM_SHADOW_CASCADES, (const float*)frustumPlanesShadow);
+	glUniform4fv(uniformLocs.frustumPlanesShadow, 4 * NUM_SHADOW_CASCADES, (const float*)shadowMapMatrices.frustumPlanes);
+	glUniform1fv(uniformLocs.shadowTexelSize, NUM_SHADOW_CASCADES, shadowMapMatrices.texelSizes);
+	glUniform1ui(uniformLocs.shadowCasterBoundsOffset, casterBoundsOffset);
+	
+	uint32_t shadowRedrawMask = 0;
+	for (uint32_t i = 0; i < NUM_SHADOW_CASCADES; i++) {
+		if (shadowMapMatrices.needsRedraw[i])
+			shadowRedrawMask |= 1U << i;
+	}
+	glUniform1ui(uniformLocs.shadowRedrawMask, shadowRedrawMask);
+	
+	glDispatchCompute((numAsteroids + COMPUTE_SHADER_LOCAL_SIZE_X - 1) / COMPUTE_SHADER_LOCAL_SIZE_X, 1, 1);
+	glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+	
+	if (settings::clusterCulling) {
+		//One work group per slot, slots past the count return immediately
+		asteroidClusterShader.use();
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, asteroidsTransformTSBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, asteroidsTransformRBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, asteroidsSettingsBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, asteroidsDrawDataBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, asteroidsClusterBoundsBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, asteroidsClusterCullListBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, asteroidIndexBuffer);
+		glUniform4fv(uniformLocs.clusterFrustumPlanes, 6, (const float*)frustumPlanes);
+		
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		glDispatchCompute(MAX_CLUSTER_CULL_ASTEROIDS, 1, 1);
+		glMemoryBarrier(GL_ELEMENT_ARRAY_BARRIER_BIT);
+	}
+}
+
+void cullOccludedAsteroids() {
+	constexpr uint32_t COMPUTE_SHADER_LOCAL_SIZE_X = 64;
+	
+	//The fence for this frame cycle index has been waited on, so the statistics
+	// written frameCycleLen frames ago can be read before the range is reused.
+	const uint32_t cullStatsOffset = renderer::frameCycleIndex * CULL_STATS_STRIDE;
+	asteroidCullStats.inFrustum = asteroidsCullStatsMemory[cullStatsOffset + 0];
+	asteroidCullStats.occluded = asteroidsCullStatsMemory[cullStatsOffset + 1];
+	asteroidCullStats.drawnSecondPass = asteroidsCullStatsMemory[cullStatsOffset + 2];
+	glClearNamedBufferSubData(asteroidsCullStatsBuffer, GL_R32UI, cullStatsOffset * sizeof(uint32_t),
+		CULL_STATS_STRIDE * sizeof(uint32_t), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	
+	asteroidOcclusionShader.use();
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, asteroidsSettingsBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, asteroidsTransformTSBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, asteroidsDrawDataBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, asteroidsVisibilityBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, asteroidsCullStatsBuffer);
+	renderer::depthPyramid.bind(0);
 	
+	glUniform1ui(uniformLocs.cullStatsOffset, cullStatsOffset);
+	
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
 	glDispatchCompute((numAsteroids + COMPUTE_SHADER_LOCAL_SIZE_X - 1) / COMPUTE_SHADER_LOCAL_SIZE_X, 1, 1);
+	glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
 }
 
 void drawAsteroidsShadow(uint32_t cascade, const glm::mat4& shadowMatrix) {
@@ -360,6 +1456,7 @@ void drawAsteroidsShadow(uint32_t cascade, const glm::mat4& shadowMatrix) {
 	
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, asteroidsTransformTSBuffer);
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, asteroidsTransformRBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, asteroidsSettingsBuffer);
 	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
 	
 	glUniformMatrix4fv(0, 1, false, (const float*)&shadowMatrix);
@@ -368,7 +1465,23 @@ void drawAsteroidsShadow(uint32_t cascade, const glm::mat4& shadowMatrix) {
 	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, (const void*)commandsOffset, numAsteroids, 0);
 }
 
-void drawAsteroids(bool wireframe) {
+void drawAsteroidsShadowLayered() {
+	glBindVertexArray(asteroidVao);
+	asteroidShadowLayeredShader.use();
+	
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, asteroidsDrawDataBuffer);
+	
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, asteroidsTransformTSBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, asteroidsTransformRBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, asteroidsSettingsBuffer);
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+	
+	//The shadow ranges are consecutive, so one multi-draw covers every cascade
+	uintptr_t commandsOffset = bytesPerDrawDataRange;
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, (const void*)commandsOffset, numAsteroids * NUM_SHADOW_CASCADES, 0);
+}
+
+void drawAsteroids(bool wireframe, bool secondPass) {
 	glBindVertexArray(asteroidVao);
 	asteroidShader.use();
 	
@@ -380,12 +1493,24 @@ void drawAsteroids(bool wireframe) {
 	
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, asteroidsTransformTSBuffer);
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, asteroidsTransformRBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, asteroidsSettingsBuffer);
 	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
 	
 	res::asteroidAlbedo.bind(0);
 	res::asteroidNormals.bind(1);
 	
-	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, nullptr, numAsteroids, 0);
+	uintptr_t commandsOffset = secondPass ? bytesPerDrawDataRange * SECOND_PASS_DRAW_DATA_RANGE : 0;
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, (const void*)commandsOffset, numAsteroids, 0);
+	
+	//Impostors are cheap enough that all of them are drawn in the first pass, without occlusion culling
+	if (!secondPass) {
+		asteroidImpostorShader.use();
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, asteroidsImpostorListBuffer);
+		glBindTextureUnit(0, impostorAlbedoTexture);
+		glBindTextureUnit(1, impostorNormalDepthTexture);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, asteroidsImpostorListBuffer);
+		glDrawArraysIndirect(GL_TRIANGLES, nullptr);
+	}
 	
 	if (wireframe) {
 		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
@@ -393,11 +1518,38 @@ void drawAsteroids(bool wireframe) {
 }
 
 bool anyAsteroidIntersects(const glm::vec3& position, float sphereRadius) {
-	for (const AsteroidInstance& asteroid : asteroids) {
-		glm::vec3 pos = glm::mod(asteroid.pos + asteroidWrappingOffset, ASTEROID_BOX_SIZE) + asteroidGlobalOffset;
-		float sphereSum = asteroid.radius + sphereRadius;
-		if (glm::distance2(pos, position) < sphereSum * sphereSum) {
-			return true;
+	const glm::ivec3 chunkMin = glm::ivec3(glm::floor((position - sphereRadius) / chunkSize)) + originChunk;
+	const glm::ivec3 chunkMax = glm::ivec3(glm::floor((position + sphereRadius) / chunkSize)) + originChunk;
+	for (int cx = chunkMin.x; cx <= chunkMax.x; cx++) {
+		for (int cy = chunkMin.y; cy <= chunkMax.y; cy++) {
+			for (int cz = chunkMin.z; cz <= chunkMax.z; cz++) {
+				const glm::ivec3 coord(cx, cy, cz);
+				const glm::vec3 chunkOrigin = getChunkOrigin(coord);
+				auto intersects = [&] (const glm::vec3& pos, float radius) {
+					float sphereSum = radius + sphereRadius;
+					return glm::distance2(pos + chunkOrigin, position) < sphereSum * sphereSum;
+				};
+				
+				auto residentIt = residentChunks.find(coord);
+				if (residentIt != residentChunks.end()) {
+					const AsteroidChunk& chunk = chunkSlots[residentIt->second];
+					while (chunk.awaitingPlacement && !placementBatches.empty()) {
+						finishPlacementBatch(true);
+					}
+					for (const AsteroidInstance& asteroid : chunk.asteroids) {
+						if (intersects(asteroid.pos, asteroid.radius))
+							return true;
+					}
+					continue;
+				}
+				
+				//Targets are placed far outside the streamed area, so chunks that aren't resident are placed here
+				const GeneratedChunk generated = settings::gpuAsteroidPlacement ? placeChunkForReadback(coord) : generateChunk(coord);
+				for (auto [pos, variant] : generated.asteroids) {
+					if (intersects(pos, asteroidVariants[variant].size))
+						return true;
+				}
+			}
 		}
 	}
 	return false;
@@ -451,9 +1603,7 @@ bool anyAsteroidIntersects(const glm::vec3& rectMin, const glm::vec3& rectMax,
 		collisionDebug::addLine(cornersWorld[1][1][0], cornersWorld[1][1][1], playerDebugColor);
 	}
 	
-	auto checkAsteroid = [&] (const AsteroidInstance& asteroid) -> bool {
-		glm::vec3 pos = glm::mod(asteroid.pos + asteroidWrappingOffset, ASTEROID_BOX_SIZE) + asteroidGlobalOffset;
-		
+	auto checkAsteroid = [&] (const AsteroidInstance& asteroid, const glm::vec3& pos) -> bool {
 		float radSum = asteroid.radius + sphereRadius;
 		if (glm::distance2(pos, sphereCenter) > radSum * radSum)
 			return false;
@@ -476,10 +1626,11 @@ bool anyAsteroidIntersects(const glm::vec3& rectMin, const glm::vec3& rectMax,
 		return false;
 	};
 	
-	glm::vec3 aboxMin = worldMin - asteroidGlobalOffset - asteroidWrappingOffset - 50.0f;
-	glm::vec3 aboxMax = worldMax - asteroidGlobalOffset - asteroidWrappingOffset + 50.0f;
-	glm::ivec3 cellMin(glm::floor(aboxMin / ASTEROIDS_CELL_SIZE));
-	glm::ivec3 cellMax(glm::floor(aboxMax / ASTEROIDS_CELL_SIZE));
+	const glm::vec3 aboxMin = worldMin - 50.0f;
+	const glm::vec3 aboxMax = worldMax + 50.0f;
+	const glm::ivec3 chunkMin = glm::ivec3(glm::floor(aboxMin / chunkSize)) + originChunk;
+	const glm::ivec3 chunkMax = glm::ivec3(glm::floor(aboxMax / chunkSize)) + originChunk;
+	const float cellSize = chunkSize / (float)chunkGridSize;
 	
 	static std::vector<uint32_t> lastCheckCallId;
 	static uint32_t callId = 0;
@@ -488,17 +1639,33 @@ bool anyAsteroidIntersects(const glm::vec3& rectMin, const glm::vec3& rectMax,
 	}
 	callId++;
 	
-	for (int cx = cellMin.x; cx <= cellMax.x; cx++) {
-		int cxm = ((cx % ASTEROIDS_GRID_SIZE) + ASTEROIDS_GRID_SIZE) % ASTEROIDS_GRID_SIZE;
-		for (int cy = cellMin.y; cy <= cellMax.y; cy++) {
-			int cym = ((cy % ASTEROIDS_GRID_SIZE) + ASTEROIDS_GRID_SIZE) % ASTEROIDS_GRID_SIZE;
-			for (int cz = cellMin.z; cz <= cellMax.z; cz++) {
-				int czm = ((cz % ASTEROIDS_GRID_SIZE) + ASTEROIDS_GRID_SIZE) % ASTEROIDS_GRID_SIZE;
-				for (uint32_t asteroid : asteroidGrid[cxm][cym][czm]) {
-					if (lastCheckCallId[asteroid] != callId) {
-						lastCheckCallId[asteroid] = callId;
-						if (checkAsteroid(asteroids[asteroid])) {
-							return true;
+	for (int chunkX = chunkMin.x; chunkX <= chunkMax.x; chunkX++) {
+		for (int chunkY = chunkMin.y; chunkY <= chunkMax.y; chunkY++) {
+			for (int chunkZ = chunkMin.z; chunkZ <= chunkMax.z; chunkZ++) {
+				auto residentIt = residentChunks.find(glm::ivec3(chunkX, chunkY, chunkZ));
+				if (residentIt == residentChunks.end())
+					continue;
+				
+				const uint32_t slot = residentIt->second;
+				const AsteroidChunk& chunk = chunkSlots[slot];
+				const glm::vec3 chunkOrigin = getChunkOrigin(chunk.coord);
+				const glm::ivec3 cellMin = glm::max(glm::ivec3(glm::floor((aboxMin - chunkOrigin) / cellSize)), 0);
+				const glm::ivec3 cellMax = glm::min(glm::ivec3(glm::floor((aboxMax - chunkOrigin) / cellSize)), chunkGridSize - 1);
+				
+				for (int cx = cellMin.x; cx <= cellMax.x; cx++) {
+					for (int cy = cellMin.y; cy <= cellMax.y; cy++) {
+						for (int cz = cellMin.z; cz <= cellMax.z; cz++) {
+							const int cell = (cx * chunkGridSize + cy) * chunkGridSize + cz;
+							for (uint32_t i = chunk.gridCellOffsets[cell]; i < chunk.gridCellOffsets[cell + 1]; i++) {
+								const uint32_t asteroid = chunk.gridAsteroids[i];
+								const uint32_t asteroidIdx = slot * asteroidsPerChunk + asteroid;
+								if (lastCheckCallId[asteroidIdx] != callId) {
+									lastCheckCallId[asteroidIdx] = callId;
+									if (checkAsteroid(chunk.asteroids[asteroid], chunk.asteroids[asteroid].pos + chunkOrigin)) {
+										return true;
+									}
+								}
+							}
 						}
 					}
 				}
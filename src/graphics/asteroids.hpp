@@ -2,7 +2,6 @@
 
 constexpr uint32_t ASTEROID_NUM_LOD_LEVELS = 5;
 constexpr uint32_t ASTEROID_NUM_VARIANTS = 50;
-constexpr float ASTEROID_BOX_SIZE = 4000;
 
 struct AsteroidVariant {
 	uint32_t firstLodFirstVertex;
@@ -12,21 +11,55 @@ struct AsteroidVariant {
 
 extern uint32_t numAsteroids;
 
+//Diameter of the area around the camera that asteroids are streamed in for, picked from settings::worldSize
+extern float asteroidBoxSize;
+
+struct AsteroidCullStats {
+	uint32_t inFrustum;
+	uint32_t occluded;
+	uint32_t drawnSecondPass;
+};
+
+//Statistics from the occlusion culling pass, these lag behind by frameCycleLen frames
+extern AsteroidCullStats asteroidCullStats;
+
 extern AsteroidVariant asteroidVariants[ASTEROID_NUM_VARIANTS];
 
+//Submits the asteroid shaders, these take the longest to compile so this is done before the other shaders
+void loadAsteroidShaders();
+
+//Starts a job that generates the sphere meshes, asteroid variants and the chunks around the menu camera
+void startAsteroidGeneration();
+
+bool isAsteroidGenerationDone();
+
+float asteroidGenerationProgress();
+
+//Uploads what startAsteroidGeneration generated, waiting for it if needed, then waits for all shaders to finish
 void initializeAsteroids();
 
-void clearAsteroidWrapping();
+//Renders every variant into the impostor atlas, the asteroid textures must have been uploaded
+void bakeAsteroidImpostors();
+
+//Stops the chunk generation threads
+void stopAsteroidStreaming();
 
 void setGlobalLodBias(float globalLodBias);
 
-void updateAsteroidWrapping(const glm::vec3& cameraPos);
-void prepareAsteroids(const glm::vec4 frustumPlanes[6], const std::array<glm::vec4, 4>* frustumPlanesShadow);
+//Moves renderOrigin to the camera's chunk, marks the chunks around the camera as used and requests the missing ones,
+// which are uploaded once generated. If waitForChunks is set, this returns once every chunk within view has been uploaded.
+void updateAsteroidChunks(const glm::dvec3& cameraPos, bool waitForChunks = false);
+void prepareAsteroids(const glm::vec4 frustumPlanes[6], const struct ShadowMapMatrices& shadowMapMatrices);
 
 void drawAsteroidsShadow(uint32_t cascade, const glm::mat4& shadowMatrix);
+void drawAsteroidsShadowLayered();
+
+void cullOccludedAsteroids();
 
-void drawAsteroids(bool wireframe);
+void drawAsteroids(bool wireframe, bool secondPass);
 
+//Positions are in render space. Chunks that aren't resident are generated to check against,
+// so this can be slow far from the camera. Chunks placed on the GPU are empty until they have been read back.
 bool anyAsteroidIntersects(const glm::vec3& position, float sphereRadius);
 
 bool anyAsteroidIntersects(const glm::vec3& rectMin, const glm::vec3& rectMax,
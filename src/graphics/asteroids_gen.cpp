@@ -1,14 +1,16 @@
+#include "asteroids_gen.hpp"
 #include "asteroids.hpp"
 #include "../utils.hpp"
+#include "../jobs.hpp"
 
-#include <span>
 #include <random>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 
 #include <noise/noise.h>
 
-static constexpr float SPACING_LO = 15;
-static constexpr float SPACING_HI = 40;
-
 struct ActiveSetEntry {
 	glm::vec3 pos;
 	float radiusAndSpacing;
@@ -16,7 +18,9 @@ struct ActiveSetEntry {
 	int remAttempts;
 };
 
-std::vector<std::pair<glm::vec3, uint32_t>> generateAsteroids(uint32_t seed) {
+std::vector<std::pair<glm::vec3, uint32_t>> generateAsteroids(uint32_t seed, uint32_t noiseSeed,
+	const glm::dvec3& noiseOrigin, float regionSize, float spacingScale) {
+	
 	std::vector<ActiveSetEntry> activeSet;
 	
 	std::mt19937 rng(seed);
@@ -26,24 +30,23 @@ std::vector<std::pair<glm::vec3, uint32_t>> generateAsteroids(uint32_t seed) {
 	spacingNoise.SetPersistence(0.5f);
 	spacingNoise.SetLacunarity(1.5f);
 	spacingNoise.SetFrequency(0.01f);
-	spacingNoise.SetSeed(rng());
+	spacingNoise.SetSeed(noiseSeed);
 	
 	std::uniform_int_distribution<int> variantDist(0, (int)ASTEROID_NUM_VARIANTS - 1);
 	
-	constexpr int MAX_BOX_SIZE = 5000;
 	constexpr int CELL_SIZE = 10;
-	constexpr int NUM_CELLS = MAX_BOX_SIZE / CELL_SIZE;
-	struct CellData {
-		int data[NUM_CELLS + 1][NUM_CELLS + 1][NUM_CELLS + 1];
+	const int numCells = (int)std::ceil(regionSize / CELL_SIZE);
+	const int cellsPerSide = numCells + 1;
+	std::vector<int> cellData(cellsPerSide * cellsPerSide * cellsPerSide, -1);
+	auto getCell = [&] (int x, int y, int z) -> int& {
+		return cellData[(x * cellsPerSide + y) * cellsPerSide + z];
 	};
-	CellData* cellData = new CellData;
-	memset(cellData->data, -1, sizeof(CellData));
 	
 	auto iterateAround = [&] (const glm::vec3& pos, float radius, const auto& callback) {
 		glm::ivec3 loCheckCell(glm::floor((pos - radius) / (float)CELL_SIZE));
 		glm::ivec3 hiCheckCell(glm::ceil((pos + radius) / (float)CELL_SIZE));
-		loCheckCell = glm::clamp(loCheckCell, glm::ivec3(0), glm::ivec3(NUM_CELLS));
-		hiCheckCell = glm::clamp(hiCheckCell, glm::ivec3(0), glm::ivec3(NUM_CELLS));
+		loCheckCell = glm::clamp(loCheckCell, glm::ivec3(0), glm::ivec3(numCells));
+		hiCheckCell = glm::clamp(hiCheckCell, glm::ivec3(0), glm::ivec3(numCells));
 		for (int x = loCheckCell.x; x <= hiCheckCell.x; x++) {
 			for (int y = loCheckCell.y; y <= hiCheckCell.y; y++) {
 				for (int z = loCheckCell.z; z <= hiCheckCell.z; z++) {
@@ -56,13 +59,15 @@ std::vector<std::pair<glm::vec3, uint32_t>> generateAsteroids(uint32_t seed) {
 	
 	std::vector<std::tuple<glm::vec3, uint32_t, float>> asteroids;
 	auto addAsteroid = [&] (const glm::vec3& pos, uint32_t variant) -> bool {
-		if (pos.x < 0 || pos.y < 0 || pos.z < 0 || pos.x >= ASTEROID_BOX_SIZE || pos.y >= ASTEROID_BOX_SIZE || pos.z >= ASTEROID_BOX_SIZE)
+		//Asteroids are kept entirely inside the region so that they can't intersect asteroids in neighbouring regions
+		float thisVarRadius = asteroidVariants[variant].size;
+		const float maxPos = regionSize - thisVarRadius;
+		if (pos.x < thisVarRadius || pos.y < thisVarRadius || pos.z < thisVarRadius || pos.x > maxPos || pos.y > maxPos || pos.z > maxPos)
 			return false;
 		
-		float thisVarRadius = asteroidVariants[variant].size;
 		bool ok = iterateAround(pos, thisVarRadius + CELL_SIZE, [&] (int x, int y, int z) {
-			if (cellData->data[x][y][z] != -1) {
-				auto [otherPos, otherVariant, otherSpacing] = asteroids[cellData->data[x][y][z]];
+			if (getCell(x, y, z) != -1) {
+				auto [otherPos, otherVariant, otherSpacing] = asteroids[getCell(x, y, z)];
 				float maxRad = otherSpacing + thisVarRadius;
 				if (glm::distance2(pos, otherPos) < maxRad * maxRad) {
 					return false;
@@ -73,12 +78,12 @@ std::vector<std::pair<glm::vec3, uint32_t>> generateAsteroids(uint32_t seed) {
 		if (!ok)
 			return false;
 		
-		float spacing = glm::mix(SPACING_LO, SPACING_HI, (float)spacingNoise.GetValue(pos.x, pos.y, pos.z) * 0.5f + 0.5f);
+		float spacing = spacingScale * glm::mix(ASTEROID_SPACING_LO, ASTEROID_SPACING_HI, (float)spacingNoise.GetValue(noiseOrigin.x + pos.x, noiseOrigin.y + pos.y, noiseOrigin.z + pos.z) * 0.5f + 0.5f);
 		float radiusAndSpacing = thisVarRadius + spacing;
 		float radiusAndSpacingSq = radiusAndSpacing * radiusAndSpacing;
 		iterateAround(pos, radiusAndSpacing, [&] (int x, int y, int z) {
 			if (glm::distance2(glm::vec3(x, y, z) * (float)CELL_SIZE, pos) <= radiusAndSpacingSq) {
-				cellData->data[x][y][z] = asteroids.size();
+				getCell(x, y, z) = asteroids.size();
 			}
 			return true;
 		});
@@ -92,7 +97,7 @@ std::vector<std::pair<glm::vec3, uint32_t>> generateAsteroids(uint32_t seed) {
 	
 	uint32_t firstVariant = variantDist(rng);
 	float firstRadius = asteroidVariants[firstVariant].size;
-	std::uniform_real_distribution<float> startDist(firstRadius, ASTEROID_BOX_SIZE - firstRadius);
+	std::uniform_real_distribution<float> startDist(firstRadius, regionSize - firstRadius);
 	addAsteroid(glm::vec3(startDist(rng), startDist(rng), startDist(rng)), firstVariant);
 	
 	while (!activeSet.empty()) {
@@ -108,8 +113,6 @@ std::vector<std::pair<glm::vec3, uint32_t>> generateAsteroids(uint32_t seed) {
 		}
 	}
 	
-	delete cellData;
-	
 	std::vector<std::pair<glm::vec3, uint32_t>> retAsteroids(asteroids.size());
 	for (size_t i = 0; i < asteroids.size(); i++) {
 		auto [pos, variant, dontCare] = asteroids[i];
@@ -117,3 +120,96 @@ std::vector<std::pair<glm::vec3, uint32_t>> generateAsteroids(uint32_t seed) {
 	}
 	return retAsteroids;
 }
+
+static std::mutex chunkGenMutex;
+static std::condition_variable chunkGenFinishedCv;
+static std::deque<glm::ivec3> chunkGenQueue;
+static std::vector<glm::ivec3> chunkGenInProgress;
+static std::vector<GeneratedChunk> chunkGenFinished;
+
+//Jobs that take chunks from the queue until it's empty, there are never more than there are workers
+static jobs::Counter chunkGenJobs;
+static uint32_t numChunkGenJobs = 0;
+
+static uint32_t chunkGenWorldSeed;
+static float chunkGenChunkSize;
+static float chunkGenSpacingScale;
+
+uint32_t getChunkSeed(uint32_t worldSeed, const glm::ivec3& coord) {
+	return worldSeed ^ ((uint32_t)coord.x * 73856093U) ^ ((uint32_t)coord.y * 19349663U) ^ ((uint32_t)coord.z * 83492791U);
+}
+
+GeneratedChunk generateChunk(const glm::ivec3& coord) {
+	GeneratedChunk chunk;
+	chunk.coord = coord;
+	chunk.asteroids = generateAsteroids(getChunkSeed(chunkGenWorldSeed, coord), chunkGenWorldSeed,
+		glm::dvec3(coord) * (double)chunkGenChunkSize, chunkGenChunkSize, chunkGenSpacingScale);
+	return chunk;
+}
+
+static void chunkGenJob() {
+	std::unique_lock<std::mutex> lock(chunkGenMutex);
+	while (true) {
+		if (chunkGenQueue.empty()) {
+			numChunkGenJobs--;
+			chunkGenFinishedCv.notify_all();
+			return;
+		}
+		
+		const glm::ivec3 coord = chunkGenQueue.front();
+		chunkGenQueue.pop_front();
+		chunkGenInProgress.push_back(coord);
+		lock.unlock();
+		
+		GeneratedChunk chunk = generateChunk(coord);
+		
+		lock.lock();
+		chunkGenInProgress.erase(std::find(chunkGenInProgress.begin(), chunkGenInProgress.end(), chunk.coord));
+		chunkGenFinished.push_back(std::move(chunk));
+		chunkGenFinishedCv.notify_all();
+	}
+}
+
+void startChunkGeneration(uint32_t worldSeed, float chunkSize, float spacingScale) {
+	chunkGenWorldSeed = worldSeed;
+	chunkGenChunkSize = chunkSize;
+	chunkGenSpacingScale = spacingScale;
+}
+
+void stopChunkGeneration() {
+	{
+		std::lock_guard<std::mutex> lock(chunkGenMutex);
+		chunkGenQueue.clear();
+	}
+	jobs::wait(chunkGenJobs);
+}
+
+void setChunkGenerationQueue(std::span<const glm::ivec3> coords) {
+	std::lock_guard<std::mutex> lock(chunkGenMutex);
+	chunkGenQueue.clear();
+	for (const glm::ivec3& coord : coords) {
+		bool generating = std::find(chunkGenInProgress.begin(), chunkGenInProgress.end(), coord) != chunkGenInProgress.end() ||
+			std::any_of(chunkGenFinished.begin(), chunkGenFinished.end(), [&] (const GeneratedChunk& chunk) { return chunk.coord == coord; });
+		if (!generating) {
+			chunkGenQueue.push_back(coord);
+		}
+	}
+	
+	const uint32_t numJobs = std::min<uint32_t>(chunkGenQueue.size(), std::max(jobs::numWorkers(), 1U));
+	for (; numChunkGenJobs < numJobs; numChunkGenJobs++) {
+		jobs::run("generate chunk", chunkGenJob, &chunkGenJobs);
+	}
+}
+
+void takeGeneratedChunks(std::vector<GeneratedChunk>& finishedChunks, bool wait) {
+	std::unique_lock<std::mutex> lock(chunkGenMutex);
+	if (wait) {
+		chunkGenFinishedCv.wait(lock, [] {
+			return !chunkGenFinished.empty() || (chunkGenQueue.empty() && chunkGenInProgress.empty());
+		});
+	}
+	for (GeneratedChunk& chunk : chunkGenFinished) {
+		finishedChunks.push_back(std::move(chunk));
+	}
+	chunkGenFinished.clear();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <span>
+
+//Range of the free space kept around each asteroid, scaled by the world's spacing scale and picked between by noise
+constexpr float ASTEROID_SPACING_LO = 15;
+constexpr float ASTEROID_SPACING_HI = 40;
+
+//Asteroids of one chunk, the positions are relative to the chunk's minimum corner
+struct GeneratedChunk {
+	glm::ivec3 coord;
+	std::vector<std::pair<glm::vec3, uint32_t>> asteroids;
+};
+
+//Places asteroids entirely inside [0, regionSize)^3. The spacing noise is sampled at noiseOrigin plus
+// the local position, so that the density is continuous across neighbouring regions.
+std::vector<std::pair<glm::vec3, uint32_t>> generateAsteroids(uint32_t seed, uint32_t noiseSeed,
+	const glm::dvec3& noiseOrigin, float regionSize, float spacingScale);
+
+uint32_t getChunkSeed(uint32_t worldSeed, const glm::ivec3& coord);
+
+//Sets the parameters that chunks are generated with, chunks are generated as jobs
+void startChunkGeneration(uint32_t worldSeed, float chunkSize, float spacingScale);
+
+//Generates a chunk on the calling thread, with the parameters given to startChunkGeneration
+GeneratedChunk generateChunk(const glm::ivec3& coord);
+void stopChunkGeneration();
+
+//Replaces the chunks waiting to be generated, which are generated in order.
+// Chunks that are being generated or haven't been taken yet are skipped.
+void setChunkGenerationQueue(std::span<const glm::ivec3> coords);
+
+//Moves the chunks that have finished generating to finishedChunks. If wait is set this blocks until
+// at least one chunk is finished, unless nothing is queued.
+void takeGeneratedChunks(std::vector<GeneratedChunk>& finishedChunks, bool wait);
@@ -37,6 +37,12 @@ GL_FUNC(glTextureStorage3D, PFNGLTEXTURESTORAGE3DPROC)
 GL_FUNC(glTexStorage3D, PFNGLTEXSTORAGE3DPROC)
 GL_FUNC(glTextureSubImage3D, PFNGLTEXTURESUBIMAGE3DPROC)
 GL_FUNC(glGetTextureImage, PFNGLGETTEXTUREIMAGEPROC)
+GL_FUNC(glGetTextureSubImage, PFNGLGETTEXTURESUBIMAGEPROC)
+GL_FUNC(glGetCompressedTextureImage, PFNGLGETCOMPRESSEDTEXTUREIMAGEPROC)
+GL_FUNC(glGetTextureLevelParameteriv, PFNGLGETTEXTURELEVELPARAMETERIVPROC)
+GL_FUNC(glCompressedTextureSubImage2D, PFNGLCOMPRESSEDTEXTURESUBIMAGE2DPROC)
+GL_FUNC(glCompressedTextureSubImage3D, PFNGLCOMPRESSEDTEXTURESUBIMAGE3DPROC)
+GL_FUNC(glGetInternalformativ, PFNGLGETINTERNALFORMATIVPROC)
 GL_FUNC(glGetnTexImage, PFNGLGETNTEXIMAGEPROC)
 
 GL_FUNC(glGenVertexArrays, PFNGLGENVERTEXARRAYSPROC)
@@ -86,11 +92,18 @@ GL_FUNC(glCompileShader, PFNGLCOMPILESHADERPROC)
 GL_FUNC(glShaderSource, PFNGLSHADERSOURCEPROC)
 GL_FUNC(glGetShaderiv, PFNGLGETSHADERIVPROC)
 GL_FUNC(glGetShaderInfoLog, PFNGLGETSHADERINFOLOGPROC)
+GL_FUNC(glDetachShader, PFNGLDETACHSHADERPROC)
+GL_FUNC(glProgramParameteri, PFNGLPROGRAMPARAMETERIPROC)
+GL_FUNC(glProgramBinary, PFNGLPROGRAMBINARYPROC)
+GL_FUNC(glGetProgramBinary, PFNGLGETPROGRAMBINARYPROC)
+GL_FUNC(glMaxShaderCompilerThreadsKHR, PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)
 
 GL_FUNC(glUniform1f, PFNGLUNIFORM1FPROC)
 GL_FUNC(glUniform1i, PFNGLUNIFORM1IPROC)
+GL_FUNC(glUniform1ui, PFNGLUNIFORM1UIPROC)
 GL_FUNC(glUniform2f, PFNGLUNIFORM2FPROC)
 GL_FUNC(glUniform2i, PFNGLUNIFORM2IPROC)
+GL_FUNC(glUniform2ui, PFNGLUNIFORM2UIPROC)
 GL_FUNC(glUniform3f, PFNGLUNIFORM3FPROC)
 GL_FUNC(glUniform3i, PFNGLUNIFORM3IPROC)
 GL_FUNC(glUniform4f, PFNGLUNIFORM4FPROC)
@@ -158,8 +171,23 @@ GL_FUNC(glProgramUniform1ui, PFNGLPROGRAMUNIFORM1UIPROC)
 
 GL_FUNC(glDrawElementsBaseVertex, PFNGLDRAWELEMENTSBASEVERTEXPROC)
 GL_FUNC(glGetIntegeri_v, PFNGLGETINTEGERI_VPROC)
+GL_FUNC(glGetStringi, PFNGLGETSTRINGIPROC)
+GL_FUNC(glCopyImageSubData, PFNGLCOPYIMAGESUBDATAPROC)
+GL_FUNC(glCreateQueries, PFNGLCREATEQUERIESPROC)
+GL_FUNC(glBeginQuery, PFNGLBEGINQUERYPROC)
+GL_FUNC(glEndQuery, PFNGLENDQUERYPROC)
+GL_FUNC(glGetQueryObjectui64v, PFNGLGETQUERYOBJECTUI64VPROC)
+GL_FUNC(glQueryCounter, PFNGLQUERYCOUNTERPROC)
 
 GL_FUNC(glBindSampler, PFNGLBINDSAMPLERPROC)
+GL_FUNC(glCreateSamplers, PFNGLCREATESAMPLERSPROC)
+GL_FUNC(glSamplerParameteri, PFNGLSAMPLERPARAMETERIPROC)
+GL_FUNC(glBindImageTexture, PFNGLBINDIMAGETEXTUREPROC)
+GL_FUNC(glClearNamedBufferSubData, PFNGLCLEARNAMEDBUFFERSUBDATAPROC)
+GL_FUNC(glCopyNamedBufferSubData, PFNGLCOPYNAMEDBUFFERSUBDATAPROC)
+GL_FUNC(glGetNamedBufferSubData, PFNGLGETNAMEDBUFFERSUBDATAPROC)
 GL_FUNC(glDispatchCompute, PFNGLDISPATCHCOMPUTEPROC)
 GL_FUNC(glMultiDrawElementsIndirect, PFNGLMULTIDRAWELEMENTSINDIRECTPROC)
+GL_FUNC(glDrawArraysIndirect, PFNGLDRAWARRAYSINDIRECTPROC)
+GL_FUNC(glNamedFramebufferDrawBuffers, PFNGLNAMEDFRAMEBUFFERDRAWBUFFERSPROC)
 #endif
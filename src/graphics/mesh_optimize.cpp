@@ -0,0 +1,238 @@
+#include "mesh_optimize.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+constexpr uint32_t FIFO_CACHE_SIZE = 16;
+
+VertexCacheStats analyzeVertexCache(std::span<const uint32_t> indices, uint32_t numVertices) {
+	//The vertex is in the cache if it was added less than FIFO_CACHE_SIZE misses ago
+	std::vector<uint32_t> addedAtMiss(numVertices, UINT32_MAX);
+	uint32_t misses = 0;
+	for (uint32_t index : indices) {
+		if (addedAtMiss[index] == UINT32_MAX || misses - addedAtMiss[index] >= FIFO_CACHE_SIZE) {
+			addedAtMiss[index] = misses++;
+		}
+	}
+	
+	VertexCacheStats stats;
+	stats.acmr = indices.empty() ? 0 : (float)misses / (float)(indices.size() / 3);
+	stats.atvr = numVertices == 0 ? 0 : (float)misses / (float)numVertices;
+	return stats;
+}
+
+constexpr uint32_t LRU_CACHE_SIZE = 32;
+constexpr float CACHE_DECAY_POWER = 1.5f;
+constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+constexpr float VALENCE_BOOST_SCALE = 2.0f;
+constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+static float vertexScore(int cachePosition, uint32_t remainingTriangles) {
+	if (remainingTriangles == 0)
+		return -1;
+	
+	float score = 0;
+	if (cachePosition >= 0) {
+		if (cachePosition < 3) {
+			//The vertices of the last triangle get a fixed score so that the next triangle doesn't just reuse them
+			score = LAST_TRIANGLE_SCORE;
+		} else {
+			const float scale = 1.0f / (float)(LRU_CACHE_SIZE - 3);
+			score = std::pow(1.0f - (float)(cachePosition - 3) * scale, CACHE_DECAY_POWER);
+		}
+	}
+	
+	//Vertices with few remaining triangles are preferred, so that they leave the working set sooner
+	return score + VALENCE_BOOST_SCALE * std::pow((float)remainingTriangles, -VALENCE_BOOST_POWER);
+}
+
+void optimizeVertexCache(std::span<uint32_t> indices, uint32_t numVertices) {
+	const uint32_t numTriangles = indices.size() / 3;
+	
+	//Triangles using each vertex, as ranges in vertexTriangles
+	std::vector<uint32_t> remainingTriangles(numVertices, 0);
+	for (uint32_t index : indices) {
+		remainingTriangles[index]++;
+	}
+	std::vector<uint32_t> vertexTrianglesOffset(numVertices + 1, 0);
+	for (uint32_t v = 0; v < numVertices; v++) {
+		vertexTrianglesOffset[v + 1] = vertexTrianglesOffset[v] + remainingTriangles[v];
+	}
+	std::vector<uint32_t> vertexTriangles(indices.size());
+	std::vector<uint32_t> vertexTrianglesFill(vertexTrianglesOffset.begin(), vertexTrianglesOffset.end() - 1);
+	for (uint32_t t = 0; t < numTriangles; t++) {
+		for (uint32_t i = 0; i < 3; i++) {
+			vertexTriangles[vertexTrianglesFill[indices[t * 3 + i]]++] = t;
+		}
+	}
+	
+	std::vector<int> cachePosition(numVertices, -1);
+	std::vector<float> scores(numVertices);
+	for (uint32_t v = 0; v < numVertices; v++) {
+		scores[v] = vertexScore(-1, remainingTriangles[v]);
+	}
+	
+	std::vector<float> triangleScores(numTriangles);
+	for (uint32_t t = 0; t < numTriangles; t++) {
+		triangleScores[t] = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+	}
+	
+	std::vector<bool> emitted(numTriangles, false);
+	std::vector<uint32_t> newIndices;
+	newIndices.reserve(indices.size());
+	
+	std::vector<uint32_t> cache;
+	std::vector<uint32_t> newCache;
+	uint32_t nextUnemittedCandidate = 0;
+	int bestTriangle = -1;
+	
+	for (uint32_t emittedCount = 0; emittedCount < numTriangles; emittedCount++) {
+		//Falls back to the highest scoring remaining triangle when none of the cached vertices have any left
+		if (bestTriangle == -1) {
+			float bestScore = -1;
+			for (uint32_t t = nextUnemittedCandidate; t < numTriangles; t++) {
+				if (!emitted[t] && triangleScores[t] > bestScore) {
+					bestScore = triangleScores[t];
+					bestTriangle = t;
+				}
+			}
+			while (nextUnemittedCandidate < numTriangles && emitted[nextUnemittedCandidate]) {
+				nextUnemittedCandidate++;
+			}
+		}
+		
+		const uint32_t* triangle = &indices[bestTriangle * 3];
+		newIndices.insert(newIndices.end(), triangle, triangle + 3);
+		emitted[bestTriangle] = true;
+		
+		newCache.assign(triangle, triangle + 3);
+		for (uint32_t v : cache) {
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+				newCache.push_back(v);
+			}
+		}
+		for (uint32_t i = 0; i < 3; i++) {
+			remainingTriangles[triangle[i]]--;
+		}
+		
+		//Updates the scores of the vertices that were or are in the cache, and their triangles
+		for (uint32_t v : cache) {
+			cachePosition[v] = -1;
+		}
+		for (uint32_t i = 0; i < newCache.size(); i++) {
+			const uint32_t v = newCache[i];
+			cachePosition[v] = i < LRU_CACHE_SIZE ? (int)i : -1;
+			const float newScore = vertexScore(cachePosition[v], remainingTriangles[v]);
+			const float scoreDiff = newScore - scores[v];
+			scores[v] = newScore;
+			for (uint32_t j = vertexTrianglesOffset[v]; j < vertexTrianglesOffset[v + 1]; j++) {
+				triangleScores[vertexTriangles[j]] += scoreDiff;
+			}
+		}
+		if (newCache.size() > LRU_CACHE_SIZE) {
+			newCache.resize(LRU_CACHE_SIZE);
+		}
+		std::swap(cache, newCache);
+		
+		bestTriangle = -1;
+		float bestScore = -1;
+		for (uint32_t v : cache) {
+			for (uint32_t j = vertexTrianglesOffset[v]; j < vertexTrianglesOffset[v + 1]; j++) {
+				const uint32_t t = vertexTriangles[j];
+				if (!emitted[t] && triangleScores[t] > bestScore) {
+					bestScore = triangleScores[t];
+					bestTriangle = t;
+				}
+			}
+		}
+	}
+	
+	std::copy(newIndices.begin(), newIndices.end(), indices.begin());
+}
+
+void optimizeOverdraw(std::span<uint32_t> indices, std::span<const glm::vec3> positions) {
+	const uint32_t numTriangles = indices.size() / 3;
+	if (numTriangles == 0)
+		return;
+	
+	//Splits the triangles into clusters where all three vertices miss the FIFO cache
+	std::vector<uint32_t> clusterStarts;
+	std::vector<uint32_t> addedAtMiss(positions.size(), UINT32_MAX);
+	uint32_t misses = 0;
+	for (uint32_t t = 0; t < numTriangles; t++) {
+		uint32_t triangleMisses = 0;
+		for (uint32_t i = 0; i < 3; i++) {
+			const uint32_t v = indices[t * 3 + i];
+			if (addedAtMiss[v] == UINT32_MAX || misses - addedAtMiss[v] >= FIFO_CACHE_SIZE) {
+				addedAtMiss[v] = misses++;
+				triangleMisses++;
+			}
+		}
+		if (t == 0 || triangleMisses == 3) {
+			clusterStarts.push_back(t);
+		}
+	}
+	clusterStarts.push_back(numTriangles);
+	
+	glm::vec3 meshCenter(0.0f);
+	float meshArea = 0;
+	std::vector<glm::vec3> clusterCentroids;
+	std::vector<glm::vec3> clusterNormals;
+	for (size_t c = 0; c + 1 < clusterStarts.size(); c++) {
+		glm::vec3 centroid(0.0f);
+		glm::vec3 normal(0.0f);
+		float area = 0;
+		for (uint32_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++) {
+			const glm::vec3& p0 = positions[indices[t * 3]];
+			const glm::vec3& p1 = positions[indices[t * 3 + 1]];
+			const glm::vec3& p2 = positions[indices[t * 3 + 2]];
+			const glm::vec3 areaNormal = glm::cross(p1 - p0, p2 - p0);
+			const float triangleArea = glm::length(areaNormal);
+			centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+			normal += areaNormal;
+			area += triangleArea;
+		}
+		meshCenter += centroid;
+		meshArea += area;
+		clusterCentroids.push_back(area > 0 ? centroid / area : centroid);
+		clusterNormals.push_back(glm::length2(normal) > 0 ? glm::normalize(normal) : normal);
+	}
+	if (meshArea > 0) {
+		meshCenter /= meshArea;
+	}
+	
+	std::vector<float> sortKeys(clusterCentroids.size());
+	for (size_t c = 0; c < clusterCentroids.size(); c++) {
+		sortKeys[c] = glm::dot(clusterCentroids[c] - meshCenter, clusterNormals[c]);
+	}
+	
+	std::vector<uint32_t> clusterOrder(clusterCentroids.size());
+	std::iota(clusterOrder.begin(), clusterOrder.end(), 0);
+	std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&] (uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+	
+	std::vector<uint32_t> newIndices;
+	newIndices.reserve(indices.size());
+	for (uint32_t c : clusterOrder) {
+		newIndices.insert(newIndices.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + clusterStarts[c + 1] * 3);
+	}
+	std::copy(newIndices.begin(), newIndices.end(), indices.begin());
+}
+
+std::vector<uint32_t> optimizeVertexFetch(std::span<uint32_t> indices, uint32_t numVertices) {
+	std::vector<uint32_t> remap(numVertices, UINT32_MAX);
+	uint32_t nextVertex = 0;
+	for (uint32_t& index : indices) {
+		if (remap[index] == UINT32_MAX) {
+			remap[index] = nextVertex++;
+		}
+		index = remap[index];
+	}
+	
+	//Vertices that aren't used by any triangle go last
+	for (uint32_t& newIndex : remap) {
+		if (newIndex == UINT32_MAX) {
+			newIndex = nextVertex++;
+		}
+	}
+	return remap;
+}
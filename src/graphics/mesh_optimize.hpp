@@ -0,0 +1,25 @@
+#pragma once
+
+#include <span>
+
+struct VertexCacheStats {
+	//Average number of vertex shader invocations per triangle
+	float acmr;
+	//Average number of vertex shader invocations per vertex
+	float atvr;
+};
+
+//Simulates a FIFO post-transform vertex cache
+VertexCacheStats analyzeVertexCache(std::span<const uint32_t> indices, uint32_t numVertices);
+
+//Reorders triangles for post-transform vertex cache reuse (Forsyth's linear speed optimizer)
+void optimizeVertexCache(std::span<uint32_t> indices, uint32_t numVertices);
+
+//Reorders clusters of a vertex cache optimized index buffer so that outward facing clusters, which tend to
+// occlude the others, are drawn first. Clusters are split where the cache misses on all three vertices,
+// so that the cache efficiency is kept.
+void optimizeOverdraw(std::span<uint32_t> indices, std::span<const glm::vec3> positions);
+
+//Rewrites the indices so that vertices are numbered in the order they are first used, and returns
+// the new index of every old vertex. The caller moves the vertices accordingly.
+std::vector<uint32_t> optimizeVertexFetch(std::span<uint32_t> indices, uint32_t numVertices);
@@ -1,10 +1,22 @@
 #include "model.hpp"
+#include "mesh_optimize.hpp"
 #include "../utils.hpp"
+#include "../jobs.hpp"
 
 #include <glm/gtc/packing.hpp>
 #include <tiny_obj_loader.h>
 #include <iostream>
 
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 static_assert(sizeof(Vertex) == sizeof(float) * 7);
 
 void Model::initializeVao() {
@@ -21,12 +33,16 @@ void Model::initializeVao() {
 	glVertexArrayAttribFormat(vao, 3, 2, GL_FLOAT, GL_FALSE, offsetof(Vertex, texcoord));
 }
 
-void Model::initialize(std::span<Vertex> vertices, std::span<uint32_t> indices) {
+void Model::createBuffers(std::span<const Vertex> vertices, std::span<const uint32_t> indices) {
 	glCreateBuffers(1, &vertexBuffer);
 	glNamedBufferStorage(vertexBuffer, vertices.size_bytes(), vertices.data(), 0);
 	
 	glCreateBuffers(1, &indexBuffer);
 	glNamedBufferStorage(indexBuffer, indices.size_bytes(), indices.data(), 0);
+}
+
+void Model::initialize(std::span<Vertex> vertices, std::span<uint32_t> indices) {
+	createBuffers(vertices, indices);
 	
 	sphereRadius = 0;
 	minPos = maxPos = vertices[0].pos;
@@ -81,7 +97,186 @@ void generateTangents(std::span<Vertex> vertices, std::span<const glm::vec3> nor
 	std::free(tangents2);
 }
 
+static constexpr uint32_t MESH_CACHE_MAGIC = 0x4d434753; //SGCM
+static constexpr uint32_t MESH_CACHE_VERSION = 2;
+static constexpr size_t MESH_CACHE_NAME_LEN = 32;
+
+//Mesh cache files start with this header, followed by numMeshes MeshCacheEntry, numVertices Vertex and numIndices uint32_t
+struct MeshCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t numVertices;
+	uint32_t numIndices;
+	uint32_t numMeshes;
+	float minPos[3];
+	float maxPos[3];
+	float sphereRadius;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+};
+
+struct MeshCacheEntry {
+	char name[MESH_CACHE_NAME_LEN];
+	uint32_t firstVertex;
+	uint32_t firstIndex;
+	uint32_t numIndices;
+};
+
+//Read only memory mapping of a whole file
+struct MappedFile {
+	const char* data = nullptr;
+	size_t size = 0;
+	
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+	
+	bool map(const std::string& path) {
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+			return false;
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping == nullptr)
+			return false;
+		data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		size = fileSize.QuadPart;
+		return data != nullptr;
+	}
+	
+	~MappedFile() {
+		if (data != nullptr) UnmapViewOfFile(data);
+		if (mapping != nullptr) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+	}
+#else
+	bool map(const std::string& path) {
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd == -1)
+			return false;
+		off_t fileSize = lseek(fd, 0, SEEK_END);
+		void* mapped = fileSize > 0 ? mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+		close(fd);
+		if (mapped == MAP_FAILED)
+			return false;
+		data = (const char*)mapped;
+		size = fileSize;
+		return true;
+	}
+	
+	~MappedFile() {
+		if (data != nullptr) munmap((void*)data, size);
+	}
+#endif
+};
+
+bool Model::loadMeshCache(const std::string& cachePath, const std::string& sourcePath) {
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	MappedFile file;
+	if (!readSourceInfo(sourcePath, sourceSize, sourceTime) || !file.map(cachePath) || file.size < sizeof(MeshCacheHeader))
+		return false;
+	
+	const MeshCacheHeader* header = (const MeshCacheHeader*)file.data;
+	if (header->magic != MESH_CACHE_MAGIC || header->version != MESH_CACHE_VERSION || header->sourceSize != sourceSize ||
+			header->sourceTime != sourceTime || header->numMeshes > MAX_MESHES)
+		return false;
+	
+	const size_t meshesOffset = sizeof(MeshCacheHeader);
+	const size_t verticesOffset = meshesOffset + header->numMeshes * sizeof(MeshCacheEntry);
+	const size_t indicesOffset = verticesOffset + header->numVertices * sizeof(Vertex);
+	if (file.size != indicesOffset + header->numIndices * sizeof(uint32_t))
+		return false;
+	
+	const MeshCacheEntry* entries = (const MeshCacheEntry*)(file.data + meshesOffset);
+	numMeshes = header->numMeshes;
+	for (uint32_t i = 0; i < numMeshes; i++) {
+		meshes[i].name = std::string(entries[i].name, strnlen(entries[i].name, MESH_CACHE_NAME_LEN));
+		meshes[i].firstVertex = entries[i].firstVertex;
+		meshes[i].firstIndex = entries[i].firstIndex;
+		meshes[i].numIndices = entries[i].numIndices;
+	}
+	
+	minPos = glm::vec3(header->minPos[0], header->minPos[1], header->minPos[2]);
+	maxPos = glm::vec3(header->maxPos[0], header->maxPos[1], header->maxPos[2]);
+	sphereRadius = header->sphereRadius;
+	
+	createBuffers(
+		std::span<const Vertex>((const Vertex*)(file.data + verticesOffset), header->numVertices),
+		std::span<const uint32_t>((const uint32_t*)(file.data + indicesOffset), header->numIndices));
+	return true;
+}
+
+void Model::writeMeshCache(const std::string& cachePath, const std::string& sourcePath,
+	std::span<const Vertex> vertices, std::span<const uint32_t> indices) const {
+	
+	MeshCacheHeader header = { };
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	header.numVertices = vertices.size();
+	header.numIndices = indices.size();
+	header.numMeshes = numMeshes;
+	for (int i = 0; i < 3; i++) {
+		header.minPos[i] = minPos[i];
+		header.maxPos[i] = maxPos[i];
+	}
+	header.sphereRadius = sphereRadius;
+	if (!readSourceInfo(sourcePath, header.sourceSize, header.sourceTime))
+		return;
+	
+	writeFileReplacing(cachePath, [&] (std::ostream& stream) {
+		stream.write((const char*)&header, sizeof(header));
+		for (uint32_t i = 0; i < numMeshes; i++) {
+			MeshCacheEntry entry = { };
+			std::strncpy(entry.name, meshes[i].name.c_str(), MESH_CACHE_NAME_LEN - 1);
+			entry.firstVertex = meshes[i].firstVertex;
+			entry.firstIndex = meshes[i].firstIndex;
+			entry.numIndices = meshes[i].numIndices;
+			stream.write((const char*)&entry, sizeof(entry));
+		}
+		stream.write((const char*)vertices.data(), vertices.size_bytes());
+		stream.write((const char*)indices.data(), indices.size_bytes());
+	});
+}
+
+//Reorders the triangles and vertices of a single mesh for vertex cache, overdraw and vertex fetch efficiency
+static void optimizeMesh(std::string_view name, std::span<Vertex> vertices, std::vector<glm::vec3>& normals, std::span<uint32_t> indices) {
+#ifdef DEBUG
+	VertexCacheStats statsBefore = analyzeVertexCache(indices, vertices.size());
+#endif
+	
+	std::vector<glm::vec3> positions(vertices.size());
+	for (size_t v = 0; v < vertices.size(); v++) {
+		positions[v] = vertices[v].pos;
+	}
+	
+	optimizeVertexCache(indices, vertices.size());
+	optimizeOverdraw(indices, positions);
+	std::vector<uint32_t> remap = optimizeVertexFetch(indices, vertices.size());
+	
+	std::vector<Vertex> oldVertices(vertices.begin(), vertices.end());
+	std::vector<glm::vec3> oldNormals = std::move(normals);
+	normals.resize(oldNormals.size());
+	for (size_t v = 0; v < vertices.size(); v++) {
+		vertices[remap[v]] = oldVertices[v];
+		normals[remap[v]] = oldNormals[v];
+	}
+	
+#ifdef DEBUG
+	VertexCacheStats statsAfter = analyzeVertexCache(indices, vertices.size());
+	std::cout << "mesh '" << name << "': acmr " << statsBefore.acmr << " -> " << statsAfter.acmr <<
+		", atvr " << statsBefore.atvr << " -> " << statsAfter.atvr << std::endl;
+#endif
+}
+
 void Model::loadObj(const std::string& path) {
+	//The parsed mesh, with tangents, is cached next to the obj file
+	const std::string cachePath = path + ".mesh";
+	if (loadMeshCache(cachePath, path))
+		return;
+	
 	std::vector<tinyobj::shape_t> shapes;
 	std::vector<tinyobj::material_t> materials;
 	std::string errorString;
@@ -93,7 +288,7 @@ void Model::loadObj(const std::string& path) {
 	assert(shapes.size() < MAX_MESHES);
 	
 	std::vector<Vertex> vertices;
-	std::vector<glm::vec3> normals;
+	std::vector<std::vector<glm::vec3>> meshNormals(shapes.size());
 	std::vector<uint32_t> indices;
 	
 	for (const tinyobj::shape_t& shape : shapes) {
@@ -110,7 +305,7 @@ void Model::loadObj(const std::string& path) {
 		
 		indices.insert(indices.end(), shape.mesh.indices.begin(), shape.mesh.indices.end());
 		
-		normals.clear();
+		std::vector<glm::vec3>& normals = meshNormals[numMeshes - 1];
 		
 		assert(shape.mesh.positions.size() % 3 == 0);
 		assert(shape.mesh.positions.size() == shape.mesh.normals.size());
@@ -133,12 +328,19 @@ void Model::loadObj(const std::string& path) {
 			
 			normals.push_back(normal);
 		}
-		
-		generateTangents(
-			std::span<Vertex>(&vertices[mesh.firstVertex], vertices.size() - mesh.firstVertex),
-			normals, shape.mesh.indices);
 	}
 	
+	//The meshes don't share any vertices, so they are optimized in parallel
+	jobs::parallelFor("optimize mesh", numMeshes, 1, [&] (uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			const Mesh& mesh = meshes[i];
+			std::span<Vertex> meshVertices(&vertices[mesh.firstVertex], meshNormals[i].size());
+			std::span<uint32_t> meshIndices(&indices[mesh.firstIndex], mesh.numIndices);
+			optimizeMesh(mesh.name, meshVertices, meshNormals[i], meshIndices);
+			generateTangents(meshVertices, meshNormals[i], meshIndices);
+		}
+	});
+	
 #ifdef DEBUG
 	std::cout << path << " mesh names: ";
 	for (uint32_t i = 0; i < numMeshes; i++) {
@@ -149,6 +351,7 @@ void Model::loadObj(const std::string& path) {
 #endif
 	
 	initialize(vertices, indices);
+	writeMeshCache(cachePath, path, vertices, indices);
 }
 
 uint32_t Model::findMesh(std::string_view name) const {
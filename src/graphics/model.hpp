@@ -37,6 +37,12 @@ struct Model {
 	void initialize(std::span<Vertex> vertices, std::span<uint32_t> indices);
 	void loadObj(const std::string& path);
 	
+	void createBuffers(std::span<const Vertex> vertices, std::span<const uint32_t> indices);
+	
+	bool loadMeshCache(const std::string& cachePath, const std::string& sourcePath);
+	void writeMeshCache(const std::string& cachePath, const std::string& sourcePath,
+		std::span<const Vertex> vertices, std::span<const uint32_t> indices) const;
+	
 	void destroy();
 	
 	uint32_t findMesh(std::string_view name) const;
@@ -29,6 +29,7 @@ void initializeParticles() {
 	particlesShader.attachStage(GL_VERTEX_SHADER, "particles.vs.glsl");
 	particlesShader.attachStage(GL_FRAGMENT_SHADER, "particles.fs.glsl");
 	particlesShader.link("Particles");
+	particlesShader.onReload = [] { glProgramUniform1f(particlesShader.program, 2, PARTICLE_BOX_SIZE); };
 	glProgramUniform1f(particlesShader.program, 2, PARTICLE_BOX_SIZE);
 	
 	glCreateVertexArrays(1, &particlesVao);
@@ -39,8 +40,9 @@ void initializeParticles() {
 }
 
 void drawParticles(const glm::vec3& cameraPos) {
-	glm::vec3 boxOffset = glm::floor(cameraPos / PARTICLE_BOX_SIZE) * PARTICLE_BOX_SIZE;
-	glm::vec3 wrappingOffset = PARTICLE_BOX_SIZE * 1.5f - (cameraPos - boxOffset);
+	//Wraps based on the world space position, so particles don't jump when the render origin moves
+	glm::vec3 cameraBoxPos(glm::mod(renderOrigin + glm::dvec3(cameraPos), (double)PARTICLE_BOX_SIZE));
+	glm::vec3 wrappingOffset = PARTICLE_BOX_SIZE * 1.5f - cameraBoxPos;
 	glm::vec3 globalOffset = cameraPos - PARTICLE_BOX_SIZE * 0.5f;
 	
 	particlesShader.use();
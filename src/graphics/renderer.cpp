@@ -17,19 +17,42 @@ namespace renderer {
 	Texture mainPassColorAttachment;
 	Texture mainPassDepthAttachment;
 	
-	Texture targetsPassColorAttachment;
-	Texture targetsPassDepthAttachment;
+	Texture targetsBackgroundColor;
+	Texture targetsBackgroundDepth;
+	
+	Texture depthPyramid;
+	
+	//God rays are rendered at half resolution, from a mask of which texels see the sky
+	static Texture godRaysMask;
+	static Texture godRaysAttachment;
 	
 	static constexpr uint32_t BLOOM_STEPS = 4;
 	static Texture bloomDownscaleAttachments[BLOOM_STEPS];
 	static Texture bloomBlurAttachments[BLOOM_STEPS];
 	
+	//Used by the compute bloom path, level i has the same size as bloomDownscaleAttachments[i]
+	static Texture bloomPyramid;
+	static Texture bloomBlurPyramid;
+	
 	static uint32_t fbWidth = 0;
 	static uint32_t fbHeight = 0;
 	
+	uint32_t renderWidth = 0;
+	uint32_t renderHeight = 0;
+	
+	//Scale of the render size relative to the drawable size along each axis
+	static float renderScale = 1;
+	static constexpr float MIN_RENDER_SCALE = 0.5f;
+	
+	//Timestamps written at the start of the frame and after post, read back frameCycleLen frames later
+	static GLuint frameTimestampQueries[frameCycleLen][2];
+	static bool frameTimestampQueriesUsed[frameCycleLen];
+	
+	//Used to upscale the main pass in post, the attachments themselves use nearest filtering
+	static GLuint linearSampler;
+	
 	static bool framebuffersInitialized = false;
 	GLuint mainPassFbo;
-	GLuint targetsPassFbo;
 	static GLuint bloomDownscaleFbos[BLOOM_STEPS];
 	static GLuint bloomBlurFbos[BLOOM_STEPS];
 	
@@ -42,16 +65,48 @@ namespace renderer {
 	static Shader bloomDownscaleShader;
 	static Shader bloomBlurShader;
 	static Shader postShader;
+	static Shader depthPyramidShader;
+	static Shader godRaysMaskShader;
+	static Shader godRaysShader;
+	static Shader bloomDownscaleComputeShader;
+	static Shader bloomBlurComputeShader;
+	
+	float gpuFrameTime = 0;
+	
+#ifdef DEBUG
+	float bloomGpuTimes[2] = { };
+	static GLuint bloomTimerQueries[frameCycleLen];
+	static bool bloomTimerQueriesUsed[frameCycleLen];
+	static bool bloomTimerQueriesCompute[frameCycleLen];
+	
+	//Debug builds set up both bloom paths, so that their timings can be compared by switching between them
+	constexpr bool BOTH_BLOOM_PATHS = true;
+#else
+	constexpr bool BOTH_BLOOM_PATHS = false;
+#endif
+	
+	static inline bool hasComputeBloom() {
+		return settings::bloom && (settings::computeBloom || BOTH_BLOOM_PATHS);
+	}
+	
+	static inline bool hasFragmentBloom() {
+		return settings::bloom && (!settings::computeBloom || BOTH_BLOOM_PATHS);
+	}
 	
 	void initialize() {
 		mainPassColorAttachment.format = GL_RGBA16F;
 		mainPassDepthAttachment.format = GL_DEPTH_COMPONENT32F;
-		targetsPassColorAttachment.format = GL_RGBA16F;
-		targetsPassDepthAttachment.format = GL_DEPTH_COMPONENT32F;
+		targetsBackgroundColor.format = GL_RGBA16F;
+		targetsBackgroundDepth.format = GL_DEPTH_COMPONENT32F;
+		depthPyramid.format = GL_R32F;
+		godRaysMask.format = GL_R8;
+		godRaysAttachment.format = GL_RG16F;
 		for (uint32_t i = 0; i < BLOOM_STEPS; i++) {
 			bloomDownscaleAttachments[i].format = GL_RGBA16F;
 			bloomBlurAttachments[i].format = GL_RGBA16F;
 		}
+		bloomPyramid.format = GL_RGBA16F;
+		bloomBlurPyramid.format = GL_RGBA16F;
 		
 		skyboxShader.attachStage(GL_VERTEX_SHADER, "skybox.vs.glsl");
 		skyboxShader.attachStage(GL_FRAGMENT_SHADER, "skybox.fs.glsl");
@@ -69,6 +124,37 @@ namespace renderer {
 		bloomBlurShader.attachStage(GL_FRAGMENT_SHADER, "bloom_blur.fs.glsl");
 		bloomBlurShader.link("BloomBlur");
 		
+		depthPyramidShader.attachStage(GL_COMPUTE_SHADER, "depth_pyramid.cs.glsl");
+		depthPyramidShader.link("DepthPyramid");
+		
+		godRaysMaskShader.attachStage(GL_COMPUTE_SHADER, "godrays_mask.cs.glsl");
+		godRaysMaskShader.link("GodRaysMask");
+		
+		godRaysShader.attachStage(GL_COMPUTE_SHADER, "godrays.cs.glsl");
+		godRaysShader.link("GodRays");
+		
+		if (hasComputeBloom()) {
+			bloomDownscaleComputeShader.attachStage(GL_COMPUTE_SHADER, "bloom_downscale.cs.glsl");
+			bloomDownscaleComputeShader.link("BloomDownscaleCompute");
+			
+			bloomBlurComputeShader.attachStage(GL_COMPUTE_SHADER, "bloom_blur.cs.glsl");
+			bloomBlurComputeShader.link("BloomBlurCompute");
+		}
+		
+#ifdef DEBUG
+		glCreateQueries(GL_TIME_ELAPSED, frameCycleLen, bloomTimerQueries);
+#endif
+		
+		for (uint32_t i = 0; i < frameCycleLen; i++) {
+			glCreateQueries(GL_TIMESTAMP, 2, frameTimestampQueries[i]);
+		}
+		
+		glCreateSamplers(1, &linearSampler);
+		glSamplerParameteri(linearSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glSamplerParameteri(linearSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glSamplerParameteri(linearSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glSamplerParameteri(linearSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		
 		glCreateBuffers(1, &renderSettingsUbo);
 		renderSettingsOffset = roundToNextMul(sizeof(RenderSettings), uboAlignment);
 		const int64_t bufferLen = renderSettingsOffset * frameCycleLen;
@@ -83,8 +169,7 @@ namespace renderer {
 		
 		if (framebuffersInitialized) {
 			glDeleteFramebuffers(1, &mainPassFbo);
-			glDeleteFramebuffers(1, &targetsPassFbo);
-			if (settings::bloom) {
+			if (hasFragmentBloom()) {
 				glDeleteFramebuffers(BLOOM_STEPS, bloomDownscaleFbos);
 				glDeleteFramebuffers(BLOOM_STEPS, bloomBlurFbos);
 			}
@@ -93,6 +178,8 @@ namespace renderer {
 		fbWidth = width;
 		fbHeight = height;
 		framebuffersInitialized = true;
+		renderWidth = std::max((uint32_t)std::round(width * renderScale), 1U);
+		renderHeight = std::max((uint32_t)std::round(height * renderScale), 1U);
 		
 		mainPassColorAttachment.width = width;
 		mainPassColorAttachment.height = height;
@@ -104,17 +191,50 @@ namespace renderer {
 		mainPassDepthAttachment.initialize();
 		mainPassDepthAttachment.setParamsForFramebuffer();
 		
-		targetsPassColorAttachment.width = width;
-		targetsPassColorAttachment.height = height;
-		targetsPassColorAttachment.initialize();
-		targetsPassColorAttachment.setParamsForFramebuffer();
+		targetsBackgroundColor.width = width;
+		targetsBackgroundColor.height = height;
+		targetsBackgroundColor.initialize();
+		targetsBackgroundColor.setParamsForFramebuffer();
 		
-		targetsPassDepthAttachment.width = width;
-		targetsPassDepthAttachment.height = height;
-		targetsPassDepthAttachment.initialize();
-		targetsPassDepthAttachment.setParamsForFramebuffer();
+		targetsBackgroundDepth.width = width;
+		targetsBackgroundDepth.height = height;
+		targetsBackgroundDepth.initialize();
+		targetsBackgroundDepth.setParamsForFramebuffer();
 		
-		if (settings::bloom) {
+		depthPyramid.width = std::max(width / 2, 1U);
+		depthPyramid.height = std::max(height / 2, 1U);
+		depthPyramid.mipLevels = (uint32_t)log2(std::max(depthPyramid.width, depthPyramid.height)) + 1;
+		depthPyramid.initialize();
+		depthPyramid.setParamsForFramebuffer();
+		glTextureParameteri(depthPyramid.texture, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		
+		godRaysMask.width = std::max(width / 2, 1U);
+		godRaysMask.height = std::max(height / 2, 1U);
+		godRaysMask.initialize();
+		godRaysMask.setParamsForFramebuffer();
+		glTextureParameteri(godRaysMask.texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTextureParameteri(godRaysMask.texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		
+		godRaysAttachment.width = godRaysMask.width;
+		godRaysAttachment.height = godRaysMask.height;
+		godRaysAttachment.initialize();
+		godRaysAttachment.setParamsForFramebuffer();
+		
+		if (hasComputeBloom()) {
+			bloomPyramid.width = std::max(width / 2, 1U);
+			bloomPyramid.height = std::max(height / 2, 1U);
+			bloomPyramid.mipLevels = BLOOM_STEPS;
+			bloomPyramid.initialize();
+			bloomPyramid.setParamsForFramebuffer();
+			
+			bloomBlurPyramid.width = bloomPyramid.width;
+			bloomBlurPyramid.height = bloomPyramid.height;
+			bloomBlurPyramid.mipLevels = BLOOM_STEPS;
+			bloomBlurPyramid.initialize();
+			glTextureParameteri(bloomBlurPyramid.texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTextureParameteri(bloomBlurPyramid.texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		}
+		if (hasFragmentBloom()) {
 			glCreateFramebuffers(BLOOM_STEPS, bloomDownscaleFbos);
 			glCreateFramebuffers(BLOOM_STEPS, bloomBlurFbos);
 			for (uint32_t i = 0; i < BLOOM_STEPS; i++) {
@@ -140,10 +260,37 @@ namespace renderer {
 		glCreateFramebuffers(1, &mainPassFbo);
 		glNamedFramebufferTexture(mainPassFbo, GL_COLOR_ATTACHMENT0, mainPassColorAttachment.texture, 0);
 		glNamedFramebufferTexture(mainPassFbo, GL_DEPTH_ATTACHMENT, mainPassDepthAttachment.texture, 0);
+	}
+	
+	void updateDynamicResolution() {
+		if (frameTimestampQueriesUsed[frameCycleIndex]) {
+			uint64_t startNs = 0, endNs = 0;
+			glGetQueryObjectui64v(frameTimestampQueries[frameCycleIndex][0], GL_QUERY_RESULT, &startNs);
+			glGetQueryObjectui64v(frameTimestampQueries[frameCycleIndex][1], GL_QUERY_RESULT, &endNs);
+			gpuFrameTime = std::max((endNs - startNs) / 1E6f, 0.01f);
+			const float targetTime = 1000.0f / settings::targetFps;
+			
+			//The pixel count scales with the square of the render scale. Small deviations are ignored and
+			// larger ones are only partially corrected each frame so that the resolution doesn't oscillate.
+			const float timeRatio = targetTime / gpuFrameTime;
+			if (settings::dynamicResolution && std::abs(timeRatio - 1) > 0.05f) {
+				const float wantedScale = renderScale * std::sqrt(timeRatio);
+				renderScale = glm::clamp(glm::mix(renderScale, wantedScale, 0.2f), MIN_RENDER_SCALE, 1.0f);
+			}
+		}
+		if (!settings::dynamicResolution) {
+			renderScale = 1;
+		}
 		
-		glCreateFramebuffers(1, &targetsPassFbo);
-		glNamedFramebufferTexture(targetsPassFbo, GL_COLOR_ATTACHMENT0, targetsPassColorAttachment.texture, 0);
-		glNamedFramebufferTexture(targetsPassFbo, GL_DEPTH_ATTACHMENT, targetsPassDepthAttachment.texture, 0);
+		renderWidth = std::max((uint32_t)std::round(fbWidth * renderScale), 1U);
+		renderHeight = std::max((uint32_t)std::round(fbHeight * renderScale), 1U);
+		
+		frameTimestampQueriesUsed[frameCycleIndex] = true;
+		glQueryCounter(frameTimestampQueries[frameCycleIndex][0], GL_TIMESTAMP);
+	}
+	
+	glm::vec2 getRenderScale() {
+		return glm::vec2(renderWidth, renderHeight) / glm::vec2(fbWidth, fbHeight);
 	}
 	
 	void updateRenderSettings(const RenderSettings& renderSettings) {
@@ -155,7 +302,7 @@ namespace renderer {
 	
 	void beginMainPass() {
 		glBindFramebuffer(GL_FRAMEBUFFER, mainPassFbo);
-		glViewport(0, 0, fbWidth, fbHeight);
+		glViewport(0, 0, renderWidth, renderHeight);
 		
 		glDepthMask(1);
 		glEnable(GL_DEPTH_TEST);
@@ -168,6 +315,28 @@ namespace renderer {
 		glClearBufferfv(GL_DEPTH, 0, &clearDepth);
 	}
 	
+	void buildDepthPyramid() {
+		constexpr uint32_t LOCAL_SIZE = 8;
+		
+		depthPyramidShader.use();
+		for (uint32_t i = 0; i < depthPyramid.mipLevels; i++) {
+			if (i == 0) {
+				mainPassDepthAttachment.bind(0);
+				glUniform1i(0, 0);
+			} else {
+				glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+				depthPyramid.bind(0);
+				glUniform1i(0, i - 1);
+			}
+			glBindImageTexture(0, depthPyramid.texture, i, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+			
+			uint32_t levelWidth = std::max(depthPyramid.width >> i, 1U);
+			uint32_t levelHeight = std::max(depthPyramid.height >> i, 1U);
+			glDispatchCompute((levelWidth + LOCAL_SIZE - 1) / LOCAL_SIZE, (levelHeight + LOCAL_SIZE - 1) / LOCAL_SIZE, 1);
+		}
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+	
 	constexpr float BLOOM_MIN_BRIGHTNESS = 1.0f;
 	constexpr float BLOOM_BLUR_RAD = 1.0f;
 	constexpr float BLOOM_BRIGHTNESS = 0.7f;
@@ -184,15 +353,76 @@ namespace renderer {
 		glDrawArrays(GL_TRIANGLES, 0, 6);
 	}
 	
+	static void renderGodRays() {
+		constexpr uint32_t LOCAL_SIZE = 8;
+		const uint32_t numGroupsX = (std::max(renderWidth / 2, 1U) + LOCAL_SIZE - 1) / LOCAL_SIZE;
+		const uint32_t numGroupsY = (std::max(renderHeight / 2, 1U) + LOCAL_SIZE - 1) / LOCAL_SIZE;
+		
+		godRaysMaskShader.use();
+		mainPassDepthAttachment.bind(0);
+		glBindImageTexture(0, godRaysMask.texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8);
+		glDispatchCompute(numGroupsX, numGroupsY, 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+		
+		godRaysShader.use();
+		godRaysMask.bind(0);
+		mainPassDepthAttachment.bind(1);
+		glBindImageTexture(0, godRaysAttachment.texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+		glDispatchCompute(numGroupsX, numGroupsY, 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+	
+	static void renderBloomCompute() {
+		constexpr uint32_t LOCAL_SIZE = 16;
+		const uint32_t numGroupsX = (std::max(renderWidth / 2, 1U) + LOCAL_SIZE - 1) / LOCAL_SIZE;
+		const uint32_t numGroupsY = (std::max(renderHeight / 2, 1U) + LOCAL_SIZE - 1) / LOCAL_SIZE;
+		
+		//Builds all levels in one dispatch
+		bloomDownscaleComputeShader.use();
+		glUniform1f(0, BLOOM_MIN_BRIGHTNESS);
+		mainPassColorAttachment.bind(0);
+		for (uint32_t i = 0; i < BLOOM_STEPS; i++) {
+			glBindImageTexture(i, bloomPyramid.texture, i, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+		}
+		glDispatchCompute(numGroupsX, numGroupsY, 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+		
+		//Blurs all levels in one dispatch, the blurred levels are upsampled and added in the post shader.
+		// The fragment path scales the brightness in both of its blur passes, so it's applied twice here.
+		bloomBlurComputeShader.use();
+		glUniform1f(0, BLOOM_BRIGHTNESS * BLOOM_BRIGHTNESS);
+		bloomPyramid.bind(0);
+		for (uint32_t i = 0; i < BLOOM_STEPS; i++) {
+			glBindImageTexture(i, bloomBlurPyramid.texture, i, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+		}
+		glDispatchCompute(numGroupsX, numGroupsY, BLOOM_STEPS);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+	
 	void endMainPass(const glm::vec3& vignetteColor, const glm::vec3& colorScale) {
 		glDisable(GL_DEPTH_TEST);
 		
+#ifdef DEBUG
+		if (bloomTimerQueriesUsed[frameCycleIndex]) {
+			uint64_t elapsedNs = 0;
+			glGetQueryObjectui64v(bloomTimerQueries[frameCycleIndex], GL_QUERY_RESULT, &elapsedNs);
+			bloomGpuTimes[bloomTimerQueriesCompute[frameCycleIndex]] = elapsedNs / 1E6f;
+		}
+		bloomTimerQueriesUsed[frameCycleIndex] = settings::bloom;
+		bloomTimerQueriesCompute[frameCycleIndex] = settings::computeBloom;
 		if (settings::bloom) {
+			glBeginQuery(GL_TIME_ELAPSED, bloomTimerQueries[frameCycleIndex]);
+		}
+#endif
+		
+		if (settings::bloom && settings::computeBloom) {
+			renderBloomCompute();
+		} else if (settings::bloom) {
 			//bloom downscale
 			bloomDownscaleShader.use();
 			for (uint32_t i = 0; i < BLOOM_STEPS; i++) {
 				glBindFramebuffer(GL_FRAMEBUFFER, bloomDownscaleFbos[i]);
-				glViewport(0, 0, fbWidth >> (i + 1), fbHeight >> (i + 1));
+				glViewport(0, 0, renderWidth >> (i + 1), renderHeight >> (i + 1));
 				invalidateAttachment(GL_COLOR_ATTACHMENT0);
 				if (i) {
 					glUniform1f(0, 0);
@@ -206,11 +436,11 @@ namespace renderer {
 			
 			//Bloom first blur
 			bloomBlurShader.use();
+			glUniform1f(1, BLOOM_BRIGHTNESS);
 			for (uint32_t i = 0; i < BLOOM_STEPS; i++) {
 				uint32_t curWidth = fbWidth >> (i + 1);
-				uint32_t curHeight = fbHeight >> (i + 1);
 				glBindFramebuffer(GL_FRAMEBUFFER, bloomBlurFbos[i]);
-				glViewport(0, 0, curWidth, curHeight);
+				glViewport(0, 0, renderWidth >> (i + 1), renderHeight >> (i + 1));
 				invalidateAttachment(GL_COLOR_ATTACHMENT0);
 				bloomDownscaleAttachments[i].bind(0);
 				glUniform2f(0, BLOOM_BLUR_RAD / curWidth, 0);
@@ -219,7 +449,7 @@ namespace renderer {
 			
 			//Bloom second blur
 			glBindFramebuffer(GL_FRAMEBUFFER, mainPassFbo);
-			glViewport(0, 0, fbWidth, fbHeight);
+			glViewport(0, 0, renderWidth, renderHeight);
 			glEnable(GL_BLEND);
 			glBlendFunc(GL_ONE, GL_ONE);
 			glUniform1f(1, BLOOM_BRIGHTNESS);
@@ -231,18 +461,38 @@ namespace renderer {
 			glDisable(GL_BLEND);
 		}
 		
+#ifdef DEBUG
+		if (settings::bloom) {
+			glEndQuery(GL_TIME_ELAPSED);
+		}
+#endif
+		
+		renderGodRays();
+		
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glViewport(0, 0, fbWidth, fbHeight);
 		invalidateAttachment(GL_COLOR);
 		
 		postShader.use();
 		mainPassColorAttachment.bind(0);
+		glBindSampler(0, linearSampler);
 		mainPassDepthAttachment.bind(1);
+		godRaysAttachment.bind(4);
 		glUniform3fv(0, 1, (const float*)&vignetteColor);
 		glUniform3fv(1, 1, (const float*)&colorScale);
+		if (settings::bloom && settings::computeBloom) {
+			bloomBlurPyramid.bind(3);
+			glUniform1i(2, BLOOM_STEPS);
+		} else {
+			glUniform1i(2, 0);
+		}
 		
 		glEnable(GL_FRAMEBUFFER_SRGB);
 		glDrawArrays(GL_TRIANGLES, 0, 3);
 		glDisable(GL_FRAMEBUFFER_SRGB);
+		glBindSampler(0, 0);
 		glBindSampler(2, 0);
+		
+		glQueryCounter(frameTimestampQueries[frameCycleIndex][1], GL_TIMESTAMP);
 	}
 }
@@ -18,6 +18,7 @@ struct RenderSettings {
 	float     _padding3;
 	glm::vec3 plColor;
 	float     _padding4;
+	glm::vec2 renderScale;
 };
 
 extern const glm::vec3 SUN_DIR;
@@ -32,19 +33,42 @@ namespace renderer {
 	extern Texture mainPassDepthAttachment;
 	extern GLuint mainPassFbo;
 	
-	extern Texture targetsPassColorAttachment;
-	extern Texture targetsPassDepthAttachment;
-	extern GLuint targetsPassFbo;
+	//Copies of the main pass around the targets, which the target shader samples while drawing into the main pass
+	extern Texture targetsBackgroundColor;
+	extern Texture targetsBackgroundDepth;
+	
+	extern Texture depthPyramid;
+	
+	//The main pass renders to the lower left renderWidth x renderHeight part of the attachments, which
+	// are allocated at the drawable size. Post upscales this to the drawable.
+	extern uint32_t renderWidth;
+	extern uint32_t renderHeight;
+	
+	//GPU time of the whole frame in milliseconds, lags behind by frameCycleLen frames
+	extern float gpuFrameTime;
+	
+#ifdef DEBUG
+	//GPU time spent on the fragment and compute bloom paths in milliseconds, each is the last time that path was used.
+	// Lags behind by frameCycleLen frames.
+	extern float bloomGpuTimes[2];
+#endif
 	
 	void initialize();
 	
 	void updateFramebuffers(uint32_t width, uint32_t height);
 	
+	//Picks the render size for this frame from the GPU time of the frame that last used this frame cycle index
+	void updateDynamicResolution();
+	
+	glm::vec2 getRenderScale();
+	
 	void updateRenderSettings(const RenderSettings& renderSettings);
 	
 	void drawSkybox();
 	
 	void beginMainPass();
 	
+	void buildDepthPyramid();
+	
 	void endMainPass(const glm::vec3& vignetteColor, const glm::vec3& colorScale);
 }
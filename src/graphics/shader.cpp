@@ -4,8 +4,13 @@
 
 #include <sstream>
 #include <fstream>
+#include <filesystem>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
 
-static void checkShaderStatus(std::string_view fileName, GLuint handle, GLenum statusName,
+static bool checkShaderStatus(std::string_view fileName, GLuint handle, GLenum statusName,
 	PFNGLGETSHADERIVPROC glGetFunc, PFNGLGETSHADERINFOLOGPROC getInfoLogFunc) {
 
 	GLint ok;
@@ -18,64 +23,426 @@ static void checkShaderStatus(std::string_view fileName, GLuint handle, GLenum s
 		getInfoLogFunc(handle, infoLogLen, nullptr, infoLog);
 		
 		std::cerr << "in " << fileName << "\n" << infoLog << std::endl;
-		std::abort();
 	}
+	return ok;
 }
 
-static void loadShaderCode(std::ostringstream& sourceStream, std::string_view fileName) {
+//A shader file with its includes expanded, along with every file that went into it
+struct ShaderFile {
+	std::string code;
+	std::vector<std::string> dependencies;
+	std::filesystem::file_time_type modifiedTime;
+	
+	//Files that couldn't be read, or that include such a file, are kept with this unset so that hot reloading retries them once they change
+	bool loaded = false;
+};
+
+//Shared headers are included by many stages, so each file is only read and expanded once
+static std::unordered_map<std::string, ShaderFile> shaderFiles;
+
+static std::string shaderFilePath(std::string_view fileName) {
 	std::string path(exeDirPath);
 	path.append("res/shaders/");
 	path.append(fileName);
+	return path;
+}
+
+//Returns null if the file or one of its includes can't be read
+static const ShaderFile* loadShaderFile(const std::string& fileName) {
+	auto it = shaderFiles.find(fileName);
+	if (it != shaderFiles.end())
+		return it->second.loaded ? &it->second : nullptr;
+	
+	std::string path = shaderFilePath(fileName);
+	ShaderFile file;
+	std::error_code ec;
+	file.modifiedTime = std::filesystem::last_write_time(path, ec);
+	file.dependencies.push_back(fileName);
 	
 	std::ifstream fileStream(path, std::ios::binary | std::ios::in);
 	if (!fileStream) {
 		std::cerr << "error opening shader file for reading: '" << path << "'" << std::endl;
-		std::abort();
+		shaderFiles.emplace(fileName, std::move(file));
+		return nullptr;
 	}
+	std::string source((std::istreambuf_iterator<char>(fileStream)), std::istreambuf_iterator<char>());
 	
-	sourceStream << "#line 1\n";
+	file.code = "#line 1\n";
 	
 	int lineNumber = 1;
-	std::string line;
-	while (std::getline(fileStream, line)) {
+	size_t lineStart = 0;
+	while (lineStart < source.size()) {
+		size_t lineEnd = source.find('\n', lineStart);
+		if (lineEnd == std::string::npos)
+			lineEnd = source.size();
+		std::string_view line(source.data() + lineStart, lineEnd - lineStart);
+		
 		if (line.starts_with("#include ")) {
-			loadShaderCode(sourceStream, line.substr(line.find(' ') + 1));
-			sourceStream << "#line " << (lineNumber + 1) << "\n";
+			const std::string includedName(line.substr(line.find(' ') + 1));
+			const ShaderFile* includedFile = loadShaderFile(includedName);
+			if (includedFile == nullptr) {
+				std::cerr << "included from " << fileName << ":" << lineNumber << std::endl;
+				file.dependencies.push_back(includedName);
+				file.code.clear();
+				shaderFiles.emplace(fileName, std::move(file));
+				return nullptr;
+			}
+			file.code.append(includedFile->code);
+			file.code.append("#line " + std::to_string(lineNumber + 1) + "\n");
+			for (const std::string& dependency : includedFile->dependencies) {
+				if (std::find(file.dependencies.begin(), file.dependencies.end(), dependency) == file.dependencies.end()) {
+					file.dependencies.push_back(dependency);
+				}
+			}
 		} else {
-			sourceStream << line << '\n';
+			file.code.append(line);
+			file.code.push_back('\n');
 		}
+		
+		lineStart = lineEnd + 1;
 		lineNumber++;
 	}
+	
+	file.loaded = true;
+	return &shaderFiles.emplace(fileName, std::move(file)).first->second;
 }
 
-void Shader::attachStage(GLenum stage, std::string_view fileName, std::string_view extraCode) {
-	if (program == 0) {
-		program = glCreateProgram();
-	}
+static bool tryAttachStage(Shader& shader, GLenum stage, std::string_view fileName, std::string_view extraCode) {
+	const ShaderFile* file = loadShaderFile(std::string(fileName));
+	if (file == nullptr)
+		return false;
 	
-	GLuint shader = glCreateShader(stage);
+	if (shader.program == 0) {
+		shader.program = glCreateProgram();
+	}
+	for (const std::string& dependency : file->dependencies) {
+		if (std::find(shader.dependencies.begin(), shader.dependencies.end(), dependency) == shader.dependencies.end()) {
+			shader.dependencies.push_back(dependency);
+		}
+	}
 	
 	std::ostringstream sourceStream;
 	sourceStream << "#version 450 core\n" << extraCode
-		<< "#define SHADOW_RES " << settings::shadowRes << "\n";
-	loadShaderCode(sourceStream, fileName);
+		<< "#define SHADOW_RES " << settings::shadowRes << "\n" << file->code;
 	
-	std::string glslCode = sourceStream.str();
-	const char* glslCodePtr = glslCode.c_str();
-	glShaderSource(shader, 1, &glslCodePtr, nullptr);
+	shader.stages.push_back(Shader::Stage { stage, std::string(fileName), std::string(extraCode), sourceStream.str() });
+	return true;
+}
+
+void Shader::attachStage(GLenum stage, std::string_view fileName, std::string_view extraCode) {
+	if (!tryAttachStage(*this, stage, fileName, extraCode)) {
+		std::abort();
+	}
+}
+
+ShaderCacheStats shaderCacheStats;
+
+//Bumped when the layout of cache files changes
+static constexpr uint32_t CACHE_FILE_VERSION = 1;
+
+struct CacheFileHeader {
+	uint32_t version;
+	GLenum binaryFormat;
+	uint64_t key;
+	uint64_t binaryLength;
+};
+
+static uint64_t hashFNV1a(uint64_t hash, std::string_view data) {
+	for (char c : data) {
+		hash = (hash ^ (uint8_t)c) * 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+//Program binaries are only valid for the driver that produced them, so the key includes the driver's strings
+static uint64_t calcCacheKey(const std::vector<Shader::Stage>& stages) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	hash = hashFNV1a(hash, (const char*)glGetString(GL_VENDOR));
+	hash = hashFNV1a(hash, (const char*)glGetString(GL_RENDERER));
+	hash = hashFNV1a(hash, (const char*)glGetString(GL_VERSION));
+	hash = hashFNV1a(hash, "SHADOW_RES " + std::to_string(settings::shadowRes));
+	for (const Shader::Stage& stage : stages) {
+		hash = hashFNV1a(hash, std::to_string(stage.type));
+		hash = hashFNV1a(hash, stage.code);
+	}
+	return hash;
+}
+
+static bool programBinariesSupported() {
+	static int numFormats = -1;
+	if (numFormats == -1) {
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+	}
+	return numFormats > 0;
+}
+
+static std::string cacheFilePath(const char* label) {
+	return exeDirPath + "shadercache/" + label + ".bin";
+}
+
+static bool readProgramBinary(GLuint program, const char* label, uint64_t key) {
+	std::ifstream stream(cacheFilePath(label), std::ios::binary);
+	if (!stream)
+		return false;
+	
+	CacheFileHeader header;
+	if (!stream.read((char*)&header, sizeof(header)) || header.version != CACHE_FILE_VERSION || header.key != key)
+		return false;
+	
+	std::vector<char> binary(header.binaryLength);
+	if (!stream.read(binary.data(), binary.size()))
+		return false;
+	
+	//The driver may still reject the binary, for example after an update that didn't change the version string.
+	// This is checked along with the other programs in finishShaderCompilation.
+	glProgramBinary(program, header.binaryFormat, binary.data(), binary.size());
+	return true;
+}
+
+static void saveProgramBinary(GLuint program, const char* label, uint64_t key) {
+	GLint binaryLength = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+	if (binaryLength <= 0)
+		return;
 	
-	glCompileShader(shader);
-	checkShaderStatus(fileName, shader, GL_COMPILE_STATUS, glGetShaderiv, glGetShaderInfoLog);
+	std::vector<char> binary(binaryLength);
+	CacheFileHeader header = { CACHE_FILE_VERSION, 0, key, 0 };
+	GLsizei writtenLength = 0;
+	glGetProgramBinary(program, binaryLength, &writtenLength, &header.binaryFormat, binary.data());
+	header.binaryLength = writtenLength;
 	
-	glAttachShader(program, shader);
+	std::error_code ec;
+	std::filesystem::create_directories(exeDirPath + "shadercache", ec);
+	
+	std::ofstream stream(cacheFilePath(label), std::ios::binary);
+	stream.write((const char*)&header, sizeof(header));
+	stream.write(binary.data(), writtenLength);
 }
 
-void Shader::link(const char* label) {
+static bool parallelCompileSupported() {
+	static int supported = -1;
+	if (supported == -1) {
+		supported = 0;
+		GLint numExtensions;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+		for (GLint i = 0; i < numExtensions; i++) {
+			std::string_view extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+			if (extension == "GL_KHR_parallel_shader_compile" && glMaxShaderCompilerThreadsKHR != nullptr) {
+				supported = 1;
+			}
+		}
+		if (supported) {
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		}
+	}
+	return supported;
+}
+
+//Programs that have been submitted to the driver but whose status hasn't been checked yet
+struct PendingProgram {
+	Shader* shader;
+	uint64_t cacheKey;
+	bool fromBinary;
+	std::vector<GLuint> stageShaders;
+};
+
+static std::vector<PendingProgram> pendingPrograms;
+
+//Set once the startup shaders are done, shaders linked after that are checked immediately
+static bool deferStatusChecks = true;
+
+//Programs whose cached binary was rejected and that were linked again from source. Linking resets the uniforms
+// that were set after link() at startup, so their onReload is called once every program is done.
+static std::vector<Shader*> relinkedShaders;
+
+static void submitCompile(PendingProgram& pending) {
+	GLuint program = pending.shader->program;
+	for (const Shader::Stage& stage : pending.shader->stages) {
+		GLuint shader = glCreateShader(stage.type);
+		const char* glslCodePtr = stage.code.c_str();
+		glShaderSource(shader, 1, &glslCodePtr, nullptr);
+		glCompileShader(shader);
+		glAttachShader(program, shader);
+		pending.stageShaders.push_back(shader);
+	}
+	
+	if (programBinariesSupported()) {
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
 	glLinkProgram(program);
+}
+
+static bool finishProgram(PendingProgram& pending) {
+	Shader& shader = *pending.shader;
+	
+	if (pending.fromBinary) {
+		GLint ok;
+		glGetProgramiv(shader.program, GL_LINK_STATUS, &ok);
+		if (ok) {
+			shaderCacheStats.loaded++;
+			glObjectLabel(GL_PROGRAM, shader.program, 0, shader.label.c_str());
+			return true;
+		}
+		
+		pending.fromBinary = false;
+		submitCompile(pending);
+		relinkedShaders.push_back(&shader);
+	}
+	
+	bool ok = true;
+	for (size_t i = 0; i < pending.stageShaders.size(); i++) {
+		ok &= checkShaderStatus(shader.stages[i].fileName, pending.stageShaders[i], GL_COMPILE_STATUS, glGetShaderiv, glGetShaderInfoLog);
+	}
+	ok = ok && checkShaderStatus(shader.label, shader.program, GL_LINK_STATUS, glGetProgramiv, glGetProgramInfoLog);
 	
-	checkShaderStatus(label, program, GL_LINK_STATUS, glGetProgramiv, glGetProgramInfoLog);
+	for (GLuint stageShader : pending.stageShaders) {
+		glDetachShader(shader.program, stageShader);
+		glDeleteShader(stageShader);
+	}
+	if (!ok)
+		return false;
 	
-	glObjectLabel(GL_PROGRAM, program, 0, label);
+	if (programBinariesSupported()) {
+		saveProgramBinary(shader.program, shader.label.c_str(), pending.cacheKey);
+	}
+	shaderCacheStats.compiled++;
+	glObjectLabel(GL_PROGRAM, shader.program, 0, shader.label.c_str());
+	return true;
+}
+
+static void submitProgram(Shader& shader) {
+	PendingProgram& pending = pendingPrograms.emplace_back();
+	pending.shader = &shader;
+	pending.cacheKey = programBinariesSupported() ? calcCacheKey(shader.stages) : 0;
+	pending.fromBinary = programBinariesSupported() && readProgramBinary(shader.program, shader.label.c_str(), pending.cacheKey);
+	if (!pending.fromBinary) {
+		submitCompile(pending);
+	}
+}
+
+//Every linked shader, so that hot reloading can find the programs that depend on a changed file
+static std::vector<Shader*> linkedShaders;
+
+void Shader::link(const char* programLabel) {
+	label = programLabel;
+	linkedShaders.push_back(this);
+	submitProgram(*this);
+	
+	if (!deferStatusChecks) {
+		finishShaderCompilation();
+	}
+}
+
+//With parallel compilation the driver's compiler threads may finish programs in any order, so whichever
+// programs are done are handled first. Otherwise checking the status waits for each program in turn.
+static bool finishCompletedPrograms(bool parallel) {
+	bool anyFinished = false;
+	for (size_t i = 0; i < pendingPrograms.size();) {
+		GLint completed = 1;
+		if (parallel) {
+			glGetProgramiv(pendingPrograms[i].shader->program, GL_COMPLETION_STATUS_KHR, &completed);
+		}
+		if (completed) {
+			if (!finishProgram(pendingPrograms[i]))
+				std::abort();
+			pendingPrograms.erase(pendingPrograms.begin() + i);
+			anyFinished = true;
+		} else {
+			i++;
+		}
+	}
+	return anyFinished;
+}
+
+bool pollShaderCompilation() {
+	if (!parallelCompileSupported())
+		return true;
+	finishCompletedPrograms(true);
+	return pendingPrograms.empty();
+}
+
+void finishShaderCompilation() {
+	const bool parallel = parallelCompileSupported();
+	while (!pendingPrograms.empty()) {
+		if (!finishCompletedPrograms(parallel)) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+	deferStatusChecks = false;
+	
+	for (Shader* shader : relinkedShaders) {
+		if (shader->onReload != nullptr) {
+			shader->onReload();
+		}
+	}
+	relinkedShaders.clear();
+}
+
+//Builds the shader again from its files into a new program. The old program is kept if this fails,
+// so that a typo in a shader doesn't end the game.
+static void reloadShader(Shader& shader) {
+	Shader reloaded;
+	reloaded.label = shader.label;
+	for (const Shader::Stage& stage : shader.stages) {
+		if (!tryAttachStage(reloaded, stage.type, stage.fileName, stage.extraCode)) {
+			if (reloaded.program != 0) {
+				glDeleteProgram(reloaded.program);
+			}
+			return;
+		}
+	}
+	
+	PendingProgram pending;
+	pending.shader = &reloaded;
+	pending.cacheKey = programBinariesSupported() ? calcCacheKey(reloaded.stages) : 0;
+	pending.fromBinary = false;
+	submitCompile(pending);
+	if (!finishProgram(pending)) {
+		glDeleteProgram(reloaded.program);
+		return;
+	}
+	
+	glDeleteProgram(shader.program);
+	shader.program = reloaded.program;
+	shader.stages = std::move(reloaded.stages);
+	shader.dependencies = std::move(reloaded.dependencies);
+	if (shader.onReload != nullptr) {
+		shader.onReload();
+	}
+	std::cout << "reloaded shader " << shader.label << std::endl;
+}
+
+void reloadChangedShaders() {
+	static auto lastCheckTime = std::chrono::steady_clock::now();
+	auto now = std::chrono::steady_clock::now();
+	if (now - lastCheckTime < std::chrono::milliseconds(500))
+		return;
+	lastCheckTime = now;
+	
+	std::vector<std::string> changedFiles;
+	for (const auto& [fileName, file] : shaderFiles) {
+		std::error_code ec;
+		if (std::filesystem::last_write_time(shaderFilePath(fileName), ec) != file.modifiedTime && !ec) {
+			changedFiles.push_back(fileName);
+		}
+	}
+	if (changedFiles.empty())
+		return;
+	
+	auto dependsOnChangedFile = [&] (const std::vector<std::string>& dependencies) {
+		return std::any_of(dependencies.begin(), dependencies.end(), [&] (const std::string& dependency) {
+			return std::find(changedFiles.begin(), changedFiles.end(), dependency) != changedFiles.end();
+		});
+	};
+	
+	//Expanded files that include a changed file are stale as well
+	std::erase_if(shaderFiles, [&] (const auto& file) { return dependsOnChangedFile(file.second.dependencies); });
+	
+	for (Shader* shader : linkedShaders) {
+		if (dependsOnChangedFile(shader->dependencies)) {
+			reloadShader(*shader);
+		}
+	}
 }
 
 GLuint Shader::findUniform(const char* name) const {
@@ -6,6 +6,9 @@ struct Shader {
 	GLuint program = 0;
 	
 	void attachStage(GLenum stage, std::string_view fileName, std::string_view extraCode = {});
+	
+	//Submits the program to the driver. At startup the status isn't checked until finishShaderCompilation,
+	// so the program must not be used before that.
 	void link(const char* label);
 	
 	GLuint findUniform(const char* name) const;
@@ -13,4 +16,40 @@ struct Shader {
 	void use() const {
 		glUseProgram(program);
 	}
+	
+	struct Stage {
+		GLenum type;
+		std::string fileName;
+		std::string extraCode;
+		std::string code;
+	};
+	
+	//Preprocessed stages, these are only compiled if the program binary cache has no matching binary
+	std::vector<Stage> stages;
+	
+	//All shader files used by the stages, including the included ones
+	std::vector<std::string> dependencies;
+	
+	std::string label;
+	
+	//Called after the program has been replaced by hot reloading, to set uniforms that are only set once
+	void (*onReload)() = nullptr;
 };
+
+struct ShaderCacheStats {
+	uint32_t loaded;
+	uint32_t compiled;
+};
+
+extern ShaderCacheStats shaderCacheStats;
+
+//Handles the programs that have finished compiling without waiting, and returns true once none are left.
+// Without GL_KHR_parallel_shader_compile the status can't be checked without waiting, so this returns true right away.
+bool pollShaderCompilation();
+
+//Waits for all programs linked so far and aborts if any failed to compile or link. Programs that were
+// rebuilt because their cached binary was rejected get their onReload called, since linking reset their uniforms.
+void finishShaderCompilation();
+
+//Rebuilds the programs that use shader files which have changed on disk since they were read
+void reloadChangedShaders();
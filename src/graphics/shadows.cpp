@@ -12,8 +12,15 @@
 GLuint shadowMap;
 
 static GLuint shadowMapFbos[NUM_SHADOW_CASCADES];
+static GLuint shadowMapLayeredFbo;
+
+std::string_view shadowLayerExtension;
+
+glm::vec2 shadowCasterDepthBounds[NUM_SHADOW_CASCADES];
 
 void initializeShadowMapping() {
+	std::fill_n(shadowCasterDepthBounds, NUM_SHADOW_CASCADES, glm::vec2(INFINITY, -INFINITY));
+	
 	glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &shadowMap);
 	glTextureStorage3D(shadowMap, 1, GL_DEPTH_COMPONENT32F,
 		settings::shadowRes, settings::shadowRes, NUM_SHADOW_CASCADES);
@@ -30,14 +37,109 @@ void initializeShadowMapping() {
 		glCreateFramebuffers(1, &shadowMapFbos[i]);
 		glNamedFramebufferTextureLayer(shadowMapFbos[i], GL_DEPTH_ATTACHMENT, shadowMap, 0, i);
 	}
+	
+	GLint numExtensions = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+	for (GLint i = 0; i < numExtensions; i++) {
+		std::string_view extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+		if (extension == "GL_ARB_shader_viewport_layer_array" ||
+				(extension == "GL_AMD_vertex_shader_layer" && shadowLayerExtension.empty())) {
+			shadowLayerExtension = extension;
+		}
+	}
+	
+	if (!shadowLayerExtension.empty()) {
+		glCreateFramebuffers(1, &shadowMapLayeredFbo);
+		glNamedFramebufferTexture(shadowMapLayeredFbo, GL_DEPTH_ATTACHMENT, shadowMap, 0);
+	}
 }
 
 static constexpr float CASCADE_DISTS[NUM_SHADOW_CASCADES] = { 40, 200, 500 };
 
+//Cascades with an interval above 1 are cached and only redrawn every n frames (or when the camera
+// has moved out of the cached area). The phases are staggered so that they never redraw in the same frame.
+// On schedule that is 1 + 1/4 + 1/8 cascades per frame instead of 3.
+static constexpr uint32_t CASCADE_UPDATE_INTERVAL[NUM_SHADOW_CASCADES] = { 1, 4, 8 };
+static constexpr uint32_t CASCADE_UPDATE_PHASE[NUM_SHADOW_CASCADES] = { 0, 1, 2 };
+
+//How much larger than the frustum slice's bounding sphere a cached cascade is made, which is the
+// distance the slice can move before the cascade has to be redrawn early
+static constexpr float CACHED_CASCADE_MARGIN = 0.25f;
+
+#ifdef DEBUG
+float shadowCascadeRedraws = 0;
+#endif
+
+struct CachedCascade {
+	bool valid = false;
+	glm::vec3 center;
+	float radius;
+};
+
+static CachedCascade cachedCascades[NUM_SHADOW_CASCADES];
+static uint32_t shadowFrameIndex = 0;
+
+//The render origin that the cached cascades were drawn relative to
+static glm::dvec3 cachedRenderOrigin(0.0);
+
+//Extra depth kept in front of and behind the caster bounds, as a fraction of the cascade's radius.
+// The bounds lag behind by a few frames so new casters may have moved into the cascade since.
+static constexpr float CASTER_DEPTH_MARGIN = 0.1f;
+
+static inline void setCascadeMatrices(ShadowMapMatrices& matrices, size_t cascade, const glm::mat4& matrix, const glm::mat4& inverseMatrix) {
+	matrices.matrices[cascade] = matrix;
+	matrices.inverseMatrices[cascade] = inverseMatrix;
+	
+	auto frustumPlanes6 = createFrustumPlanes(inverseMatrix);
+	std::copy_n(frustumPlanes6.begin(), 4, matrices.frustumPlanes[cascade].begin());
+}
+
+static void fitCascadeToSphere(ShadowMapMatrices& matrices, size_t cascade, const glm::mat3& rotation,
+	const glm::vec3& center, float radius) {
+	
+	//Snaps the center to the texel grid so that texels cover the same world area as the camera moves
+	const float texelSize = 2 * radius / settings::shadowRes;
+	glm::vec3 centerLS = rotation * center;
+	centerLS.x = std::floor(centerLS.x / texelSize) * texelSize;
+	centerLS.y = std::floor(centerLS.y / texelSize) * texelSize;
+	
+	//Depth clamping is enabled when rendering shadows, so casters in front of the near plane still work.
+	// The depth range can therefore be shrunk to the casters that are actually inside the cascade.
+	float nearZ = centerLS.z - radius;
+	float farZ = centerLS.z + radius;
+	if (settings::shadowSphereFit && shadowCasterDepthBounds[cascade].x <= shadowCasterDepthBounds[cascade].y) {
+		const float margin = radius * CASTER_DEPTH_MARGIN;
+		float tightNearZ = std::max(nearZ, shadowCasterDepthBounds[cascade].x - margin);
+		float tightFarZ = std::min(farZ, shadowCasterDepthBounds[cascade].y + margin);
+		if (tightFarZ > tightNearZ) {
+			nearZ = tightNearZ;
+			farZ = tightFarZ;
+		}
+	}
+	
+	glm::vec3 shadowTranslate(-centerLS.x, -centerLS.y, -(nearZ + farZ) / 2.0f);
+	glm::vec3 shadowScale(1.0f / radius, 1.0f / radius, 2.0f / (farZ - nearZ));
+	
+	setCascadeMatrices(matrices, cascade,
+		glm::scale(glm::mat4(1), shadowScale) *
+		glm::translate(glm::mat4(1), shadowTranslate) *
+		glm::mat4(rotation),
+		glm::mat4(glm::transpose(rotation)) *
+		glm::translate(glm::mat4(1), -shadowTranslate) *
+		glm::scale(glm::mat4(1), 1.0f / shadowScale));
+	matrices.texelSizes[cascade] = texelSize;
+}
+
 ShadowMapMatrices calculateShadowMapMatrices(const glm::mat4& vpMatrixInv, const glm::vec3& sunDir) {
 	glm::vec3 corners[8];
 	unprojectFrustumCorners(vpMatrixInv, corners);
-
+	
+	//Sphere fitted cascades use a rotation which doesn't depend on the camera, so that
+	// texel snapping keeps texels at the same world positions.
+	glm::vec3 stableYDir = glm::normalize(glm::cross(sunDir, std::abs(sunDir.y) < 0.99f ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0)));
+	glm::vec3 stableXDir = glm::normalize(glm::cross(sunDir, stableYDir));
+	glm::mat3 stableRotation = glm::transpose(glm::mat3(stableXDir, stableYDir, sunDir));
+	
 	glm::vec3 forward = glm::normalize(
 		multiplyAndWDivide(vpMatrixInv, glm::vec3(0, 0, 1)) -
 		multiplyAndWDivide(vpMatrixInv, glm::vec3(0, 0, -1))
@@ -48,46 +150,101 @@ ShadowMapMatrices calculateShadowMapMatrices(const glm::mat4& vpMatrixInv, const
 	glm::mat3 shadowRotationInv(xdir, ydir, sunDir);
 	glm::mat3 shadowRotation = glm::transpose(shadowRotationInv);
 	
-	ShadowMapMatrices matrices;
+	//Static since cascades which aren't redrawn this frame keep the matrices they were drawn with
+	static ShadowMapMatrices matrices;
+	
+	//Moves the cached cascades into the current render space, so they stay valid when the origin moves
+	if (renderOrigin != cachedRenderOrigin) {
+		const glm::vec3 originShift(renderOrigin - cachedRenderOrigin);
+		for (size_t i = 0; i < NUM_SHADOW_CASCADES; i++) {
+			if (!cachedCascades[i].valid)
+				continue;
+			cachedCascades[i].center -= originShift;
+			setCascadeMatrices(matrices, i,
+				matrices.matrices[i] * glm::translate(glm::mat4(1), originShift),
+				glm::translate(glm::mat4(1), -originShift) * matrices.inverseMatrices[i]);
+		}
+		cachedRenderOrigin = renderOrigin;
+	}
 	
 	float prevCascadeEndDst = 0;
 	for (size_t i = 0; i < NUM_SHADOW_CASCADES; i++) {
-		glm::vec3 minEdge(INFINITY);
-		glm::vec3 maxEdge(-INFINITY);
+		glm::vec3 sliceCorners[8];
 		for (int c = 0; c < 4; c++) {
 			glm::vec3 farDir = (corners[c + 4] - corners[c]) / (Z_FAR - Z_NEAR);
+			sliceCorners[c] = corners[c] + farDir * prevCascadeEndDst;
+			sliceCorners[c + 4] = corners[c] + farDir * CASCADE_DISTS[i];
+		}
+		prevCascadeEndDst = CASCADE_DISTS[i];
+		
+		//Cached cascades are always sphere fitted since the aabb fit changes whenever the camera rotates
+		if (settings::shadowSphereFit || CASCADE_UPDATE_INTERVAL[i] > 1) {
+			glm::vec3 sliceCenter(0.0f);
+			for (const glm::vec3& corner : sliceCorners) {
+				sliceCenter += corner;
+			}
+			sliceCenter /= 8.0f;
 			
-			glm::vec3 near = shadowRotation * (corners[c] + farDir * prevCascadeEndDst);
-			minEdge = glm::min(minEdge, near);
-			maxEdge = glm::max(maxEdge, near);
+			float sliceRadius = 0;
+			for (const glm::vec3& corner : sliceCorners) {
+				sliceRadius = std::max(sliceRadius, glm::distance(corner, sliceCenter));
+			}
 			
-			glm::vec3 far = shadowRotation * (corners[c] + farDir * CASCADE_DISTS[i]);
-			minEdge = glm::min(minEdge, far);
-			maxEdge = glm::max(maxEdge, far);
+			if (CASCADE_UPDATE_INTERVAL[i] > 1) {
+				CachedCascade& cached = cachedCascades[i];
+				bool scheduled = shadowFrameIndex % CASCADE_UPDATE_INTERVAL[i] == CASCADE_UPDATE_PHASE[i];
+				bool covered = cached.valid && glm::distance(cached.center, sliceCenter) + sliceRadius <= cached.radius;
+				matrices.needsRedraw[i] = scheduled || !covered;
+				if (!matrices.needsRedraw[i])
+					continue;
+				
+				cached.valid = true;
+				cached.center = sliceCenter;
+				cached.radius = sliceRadius * (1 + CACHED_CASCADE_MARGIN);
+				sliceRadius = cached.radius;
+			} else {
+				matrices.needsRedraw[i] = true;
+			}
+			
+			fitCascadeToSphere(matrices, i, stableRotation, sliceCenter, sliceRadius);
+			continue;
+		}
+		
+		glm::vec3 minEdge(INFINITY);
+		glm::vec3 maxEdge(-INFINITY);
+		for (const glm::vec3& corner : sliceCorners) {
+			glm::vec3 cornerLS = shadowRotation * corner;
+			minEdge = glm::min(minEdge, cornerLS);
+			maxEdge = glm::max(maxEdge, cornerLS);
 		}
 		
 		glm::vec3 shadowTranslate = -(minEdge + maxEdge) / 2.0f;
 		glm::vec3 shadowScale = glm::vec3(0.5f, 0.5f, 0.5f) / (maxEdge - minEdge);
 		
-		matrices.matrices[i] = 
+		setCascadeMatrices(matrices, i,
 			glm::scale(glm::mat4(1), shadowScale) *
 			glm::translate(glm::mat4(1), shadowTranslate) *
-			glm::mat4(shadowRotation);
-		matrices.inverseMatrices[i] = 
+			glm::mat4(shadowRotation),
 			glm::mat4(shadowRotationInv) *
 			glm::translate(glm::mat4(1), -shadowTranslate) *
-			glm::scale(glm::mat4(1), 1.0f / shadowScale);
-		
-		auto frustumPlanes6 = createFrustumPlanes(matrices.inverseMatrices[i]);
-		std::copy_n(frustumPlanes6.begin(), 4, matrices.frustumPlanes[i].begin());
+			glm::scale(glm::mat4(1), 1.0f / shadowScale));
 		
-		prevCascadeEndDst = CASCADE_DISTS[i];
+		//The shadow matrix maps [-1, 1] to the shadow map, so the world size of a texel is 2 / (scale * res)
+		matrices.texelSizes[i] = 2.0f / (std::min(shadowScale.x, shadowScale.y) * settings::shadowRes);
+		matrices.needsRedraw[i] = true;
 	}
 	
+	shadowFrameIndex++;
+	
+#ifdef DEBUG
+	const float numRedrawn = (float)std::count(matrices.needsRedraw, matrices.needsRedraw + NUM_SHADOW_CASCADES, true);
+	shadowCascadeRedraws = glm::mix(shadowCascadeRedraws, numRedrawn, 0.02f);
+#endif
+	
 	return matrices;
 }
 
-void renderShadows(const std::function<void(uint32_t)>& renderCallback) {
+void renderShadows(const ShadowMapMatrices& matrices, const std::function<void(uint32_t)>& renderCallback) {
 	glDepthMask(1);
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_DEPTH_CLAMP);
@@ -95,6 +252,9 @@ void renderShadows(const std::function<void(uint32_t)>& renderCallback) {
 	glCullFace(GL_FRONT);
 	
 	for (uint32_t cascade = 0; cascade < NUM_SHADOW_CASCADES; cascade++) {
+		if (!matrices.needsRedraw[cascade])
+			continue;
+		
 		glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFbos[cascade]);
 		glViewport(0, 0, settings::shadowRes, settings::shadowRes);
 		
@@ -107,3 +267,31 @@ void renderShadows(const std::function<void(uint32_t)>& renderCallback) {
 	glCullFace(GL_BACK);
 	glDisable(GL_DEPTH_CLAMP);
 }
+
+void renderShadowsLayered(const ShadowMapMatrices& matrices, const std::function<void()>& renderCallback) {
+	if (std::find(matrices.needsRedraw, matrices.needsRedraw + NUM_SHADOW_CASCADES, true) == matrices.needsRedraw + NUM_SHADOW_CASCADES)
+		return;
+	
+	glDepthMask(1);
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_DEPTH_CLAMP);
+	
+	glCullFace(GL_FRONT);
+	
+	glBindFramebuffer(GL_FRAMEBUFFER, shadowMapLayeredFbo);
+	glViewport(0, 0, settings::shadowRes, settings::shadowRes);
+	
+	//Only the layers being redrawn are cleared, the draw arguments for the other cascades are disabled
+	const float clearValue = 1;
+	for (uint32_t cascade = 0; cascade < NUM_SHADOW_CASCADES; cascade++) {
+		if (matrices.needsRedraw[cascade]) {
+			glClearTexSubImage(shadowMap, 0, 0, 0, cascade, settings::shadowRes, settings::shadowRes, 1,
+				GL_DEPTH_COMPONENT, GL_FLOAT, &clearValue);
+		}
+	}
+	
+	renderCallback();
+	
+	glCullFace(GL_BACK);
+	glDisable(GL_DEPTH_CLAMP);
+}
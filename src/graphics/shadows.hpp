@@ -3,9 +3,14 @@
 #include "opengl.hpp"
 
 #include <functional>
+#include <string_view>
 
 extern GLuint shadowMap;
 
+//Name of the extension used to write gl_Layer from the vertex stage, empty if there is none.
+// All cascades are rendered in a single layered pass when this is available.
+extern std::string_view shadowLayerExtension;
+
 static constexpr uint32_t NUM_SHADOW_CASCADES = 3;
 
 void initializeShadowMapping();
@@ -14,8 +19,20 @@ struct ShadowMapMatrices {
 	glm::mat4 matrices[NUM_SHADOW_CASCADES];
 	glm::mat4 inverseMatrices[NUM_SHADOW_CASCADES];
 	std::array<glm::vec4, 4> frustumPlanes[NUM_SHADOW_CASCADES];
+	float texelSizes[NUM_SHADOW_CASCADES];
+	bool needsRedraw[NUM_SHADOW_CASCADES];
 };
 
+//Range of dot(sunDir, pos) covered by shadow casting asteroids in each cascade (min in x, max in y).
+// Written by the asteroid culling pass and lags behind by a few frames, x > y means there were no casters.
+extern glm::vec2 shadowCasterDepthBounds[NUM_SHADOW_CASCADES];
+
+#ifdef DEBUG
+//Average number of cascades redrawn per frame, including the cached cascades that had to be redrawn early
+extern float shadowCascadeRedraws;
+#endif
+
 ShadowMapMatrices calculateShadowMapMatrices(const glm::mat4& vpMatrixInv, const glm::vec3& sunDir);
 
-void renderShadows(const std::function<void(uint32_t)>& renderCallback);
+void renderShadows(const ShadowMapMatrices& matrices, const std::function<void(uint32_t)>& renderCallback);
+void renderShadowsLayered(const ShadowMapMatrices& matrices, const std::function<void()>& renderCallback);
@@ -1,5 +1,7 @@
 #include "sphere.hpp"
+#include "mesh_optimize.hpp"
 #include "../utils.hpp"
+#include "../jobs.hpp"
 
 #include <unordered_map>
 
@@ -57,6 +59,50 @@ static void generateNextSphereLod(uint32_t lod) {
 	}
 }
 
+//Reorders the triangles and vertices of a lod. prevLodV1 and prevLodV2 index into the same lod
+// (the vertices of the previous lod are a prefix of it before reordering), so they are remapped too.
+static void optimizeSphereLod(uint32_t lod) {
+	std::span<uint32_t> indices(&sphereTriangles[lod][0].x, sphereTriangles[lod].size() * 3);
+	const uint32_t numVertices = sphereVertices[lod].size();
+	
+#ifdef DEBUG
+	VertexCacheStats statsBefore = analyzeVertexCache(indices, numVertices);
+#endif
+	
+	std::vector<glm::vec3> positions(numVertices);
+	for (uint32_t v = 0; v < numVertices; v++) {
+		positions[v] = sphereVertices[lod][v].pos;
+	}
+	
+	//Clusters are optimized separately so that they stay contiguous
+	if (lod >= SPHERE_CLUSTER_MIN_LOD) {
+		for (size_t i = 0; i < indices.size(); i += SPHERE_CLUSTER_TRIANGLES * 3) {
+			optimizeVertexCache(indices.subspan(i, SPHERE_CLUSTER_TRIANGLES * 3), numVertices);
+		}
+	} else {
+		optimizeVertexCache(indices, numVertices);
+		optimizeOverdraw(indices, positions);
+	}
+	std::vector<uint32_t> remap = optimizeVertexFetch(indices, numVertices);
+	
+	std::vector<SphereVertex> newVertices(numVertices);
+	for (uint32_t v = 0; v < numVertices; v++) {
+		SphereVertex vertex = sphereVertices[lod][v];
+		if (vertex.prevLodV1 != -1 && vertex.prevLodV2 != -1) {
+			vertex.prevLodV1 = remap[vertex.prevLodV1];
+			vertex.prevLodV2 = remap[vertex.prevLodV2];
+		}
+		newVertices[remap[v]] = vertex;
+	}
+	sphereVertices[lod] = std::move(newVertices);
+	
+#ifdef DEBUG
+	VertexCacheStats statsAfter = analyzeVertexCache(indices, numVertices);
+	std::cout << "sphere lod " << lod << ": acmr " << statsBefore.acmr << " -> " << statsAfter.acmr <<
+		", atvr " << statsBefore.atvr << " -> " << statsAfter.atvr << std::endl;
+#endif
+}
+
 void generateSphereMeshes() {
 	sphereVertices[0].resize(std::size(baseSphereVertices));
 	for (size_t i = 0; i < std::size(baseSphereVertices); i++) {
@@ -69,4 +115,11 @@ void generateSphereMeshes() {
 	for (uint32_t i = 1; i < NUM_SPHERE_LODS; i++) {
 		generateNextSphereLod(i);
 	}
+	
+	//Done after all lods have been generated since generateNextSphereLod relies on the previous lod's order
+	jobs::parallelFor("optimize sphere lod", NUM_SPHERE_LODS, 1, [] (uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			optimizeSphereLod(i);
+		}
+	});
 }
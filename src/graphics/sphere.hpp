@@ -2,6 +2,11 @@
 
 constexpr uint32_t NUM_SPHERE_LODS = 5;
 
+//Each triangle is subdivided into four consecutive triangles in the next lod, so in lods from
+// SPHERE_CLUSTER_MIN_LOD and up every SPHERE_CLUSTER_TRIANGLES consecutive triangles form a compact patch.
+constexpr uint32_t SPHERE_CLUSTER_MIN_LOD = 3;
+constexpr uint32_t SPHERE_CLUSTER_TRIANGLES = 1 << (2 * SPHERE_CLUSTER_MIN_LOD);
+
 struct SphereVertex {
 	glm::vec3 pos;
 	int prevLodV1 = -1;
@@ -1,23 +1,307 @@
 #include "texture.hpp"
+#include "../utils.hpp"
+#include "../jobs.hpp"
 #include <stb/stb_image.h>
 
-void Texture::load(const std::string& path, bool srgb, bool generateMipmaps) {
-	uint8_t* data = stbi_load(path.c_str(), (int*)&width, (int*)&height, nullptr, 4);
-	if (data == nullptr) {
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <filesystem>
+
+//Bumped when the layout of texture cache files changes
+static constexpr uint32_t TEXTURE_CACHE_VERSION = 1;
+
+//Texture cache files start with this header, followed by the size of each mip level and then the levels' data
+struct TextureCacheHeader {
+	uint32_t version;
+	GLenum format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t mipLevels;
+	uint32_t _padding;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+};
+
+//An image that is decoded, or read from the texture cache, by a job into its own
+// persistently mapped staging buffer, which finishTextureLoads then copies into the texture.
+struct PendingImage {
+	std::string path;
+	GLuint texture;
+	int layer;
+	uint32_t width;
+	uint32_t height;
+	uint32_t mipLevels;
+	bool generateMipmaps;
+	
+	//Block compressed format that the image is stored as in the texture cache, or 0 if it isn't cached
+	GLenum compressedFormat;
+	bool fromCache;
+	std::vector<uint32_t> cachedLevelSizes;
+	
+	GLuint stagingBuffer;
+	void* stagingMemory;
+	
+	bool decoded = false;
+	std::string error;
+};
+
+static std::vector<std::unique_ptr<PendingImage>> pendingImages;
+
+static jobs::Counter decodeJobs;
+static std::mutex decodeMutex;
+static std::condition_variable decodedCv;
+
+static std::string textureCachePath(const std::string& sourcePath) {
+	std::filesystem::path path(sourcePath);
+	return exeDirPath + "texcache/" + path.parent_path().filename().string() + "_" + path.filename().string() + ".tex";
+}
+
+static bool compressedFormatSupported(GLenum format) {
+	GLint supported = GL_FALSE;
+	glGetInternalformativ(GL_TEXTURE_2D, format, GL_INTERNALFORMAT_SUPPORTED, 1, &supported);
+	return supported == GL_TRUE;
+}
+
+//Reads the header of the cache file for an image and checks that it is up to date with the source image
+static bool readTextureCacheHeader(const std::string& sourcePath, GLenum format, uint32_t mipLevels,
+	uint32_t& widthOut, uint32_t& heightOut, std::vector<uint32_t>& levelSizesOut) {
+	
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	if (!readSourceInfo(sourcePath, sourceSize, sourceTime))
+		return false;
+	
+	const std::string cachePath = textureCachePath(sourcePath);
+	std::ifstream stream(cachePath, std::ios::binary);
+	TextureCacheHeader header;
+	if (!stream || !stream.read((char*)&header, sizeof(header)))
+		return false;
+	if (header.version != TEXTURE_CACHE_VERSION || header.format != format || header.sourceSize != sourceSize ||
+			header.sourceTime != sourceTime || header.mipLevels > 32 || (mipLevels != 0 && header.mipLevels != mipLevels))
+		return false;
+	
+	levelSizesOut.resize(header.mipLevels);
+	if (!stream.read((char*)levelSizesOut.data(), levelSizesOut.size() * sizeof(uint32_t)))
+		return false;
+	
+	//A truncated file is decoded from the source instead, since the decode job can't fall back once the texture is created
+	uint64_t expectedSize = sizeof(header) + levelSizesOut.size() * sizeof(uint32_t);
+	for (uint32_t levelSize : levelSizesOut) {
+		expectedSize += levelSize;
+	}
+	std::error_code ec;
+	const uint64_t cacheSize = std::filesystem::file_size(cachePath, ec);
+	if (ec || cacheSize != expectedSize)
+		return false;
+	
+	widthOut = header.width;
+	heightOut = header.height;
+	return true;
+}
+
+static void decodeImage(PendingImage* image) {
+	std::string error;
+	if (image->fromCache) {
+		uint64_t dataBytes = 0;
+		for (uint32_t levelSize : image->cachedLevelSizes) {
+			dataBytes += levelSize;
+		}
+		std::ifstream stream(textureCachePath(image->path), std::ios::binary);
+		stream.seekg(sizeof(TextureCacheHeader) + image->cachedLevelSizes.size() * sizeof(uint32_t));
+		if (!stream.read((char*)image->stagingMemory, dataBytes)) {
+			error = "texture cache file is truncated";
+		}
+	} else {
+		int width, height;
+		uint8_t* data = stbi_load(image->path.c_str(), &width, &height, nullptr, 4);
+		if (data == nullptr) {
+			error = stbi_failure_reason();
+		} else if ((uint32_t)width != image->width || (uint32_t)height != image->height) {
+			error = "unexpected image size";
+		} else {
+			std::memcpy(image->stagingMemory, data, (size_t)width * (size_t)height * 4);
+		}
+		free(data);
+	}
+	
+	std::lock_guard<std::mutex> lock(decodeMutex);
+	image->error = std::move(error);
+	image->decoded = true;
+	decodedCv.notify_all();
+}
+
+static void queueImage(std::unique_ptr<PendingImage> image) {
+	size_t bytes = (size_t)image->width * (size_t)image->height * 4;
+	if (image->fromCache) {
+		bytes = 0;
+		for (uint32_t levelSize : image->cachedLevelSizes) {
+			bytes += levelSize;
+		}
+	}
+	
+	const GLbitfield mapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glCreateBuffers(1, &image->stagingBuffer);
+	glNamedBufferStorage(image->stagingBuffer, bytes, nullptr, mapFlags);
+	image->stagingMemory = glMapNamedBufferRange(image->stagingBuffer, 0, bytes, mapFlags);
+	
+	jobs::run("decode image", [image = image.get()] { decodeImage(image); }, &decodeJobs);
+	
+	std::lock_guard<std::mutex> lock(decodeMutex);
+	pendingImages.push_back(std::move(image));
+}
+
+//Reads just the image header, so that the texture can be created before the image is decoded
+static void getImageSize(const std::string& path, uint32_t& width, uint32_t& height) {
+	int w, h;
+	if (!stbi_info(path.c_str(), &w, &h, nullptr)) {
 		std::cerr << "image failed to load: '" << path << "': " << stbi_failure_reason() << std::endl;
 		std::abort();
 	}
+	width = w;
+	height = h;
+}
+
+void Texture::load(const std::string& path, bool srgb, bool generateMipmaps, GLenum compressedFormat) {
+	auto image = std::make_unique<PendingImage>();
+	image->path = path;
+	image->layer = -1;
+	image->generateMipmaps = generateMipmaps;
+	image->compressedFormat = (compressedFormat != 0 && compressedFormatSupported(compressedFormat)) ? compressedFormat : 0;
+	image->fromCache = image->compressedFormat != 0 &&
+		readTextureCacheHeader(path, image->compressedFormat, 0, width, height, image->cachedLevelSizes);
 	
-	format = srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
-	mipLevels = generateMipmaps ? ((uint32_t)log2(std::max(width, height)) + 1) : 1;
+	if (image->fromCache) {
+		format = image->compressedFormat;
+		mipLevels = image->cachedLevelSizes.size();
+	} else {
+		getImageSize(path, width, height);
+		format = srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+		mipLevels = generateMipmaps ? ((uint32_t)log2(std::max(width, height)) + 1) : 1;
+	}
 	
 	initialize();
-	setData(GL_RGBA, GL_UNSIGNED_BYTE, data);
-	free(data);
+	image->texture = texture;
+	image->width = width;
+	image->height = height;
+	image->mipLevels = mipLevels;
+	queueImage(std::move(image));
+}
+
+//Compresses an image that was loaded uncompressed, by letting the driver compress each mip level
+// as it is uploaded to a texture with the compressed format, and writes it to the texture cache.
+static void writeTextureCache(const PendingImage& image) {
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	if (!readSourceInfo(image.path, sourceSize, sourceTime))
+		return;
+	
+	GLuint compressedTexture;
+	glCreateTextures(GL_TEXTURE_2D, 1, &compressedTexture);
+	glTextureStorage2D(compressedTexture, image.mipLevels, image.compressedFormat, image.width, image.height);
+	
+	std::vector<uint32_t> levelSizes(image.mipLevels);
+	std::vector<char> levelsData;
+	std::vector<char> pixels;
+	for (uint32_t level = 0; level < image.mipLevels; level++) {
+		const uint32_t levelWidth = std::max(image.width >> level, 1U);
+		const uint32_t levelHeight = std::max(image.height >> level, 1U);
+		pixels.resize((size_t)levelWidth * (size_t)levelHeight * 4);
+		if (image.layer == -1) {
+			glGetTextureImage(image.texture, level, GL_RGBA, GL_UNSIGNED_BYTE, pixels.size(), pixels.data());
+		} else {
+			glGetTextureSubImage(image.texture, level, 0, 0, image.layer, levelWidth, levelHeight, 1,
+				GL_RGBA, GL_UNSIGNED_BYTE, pixels.size(), pixels.data());
+		}
+		glTextureSubImage2D(compressedTexture, level, 0, 0, levelWidth, levelHeight, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+		
+		GLint compressedSize = 0;
+		glGetTextureLevelParameteriv(compressedTexture, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &compressedSize);
+		levelSizes[level] = compressedSize;
+		levelsData.resize(levelsData.size() + compressedSize);
+		glGetCompressedTextureImage(compressedTexture, level, compressedSize, levelsData.data() + levelsData.size() - compressedSize);
+	}
+	glDeleteTextures(1, &compressedTexture);
+	
+	TextureCacheHeader header = { TEXTURE_CACHE_VERSION, image.compressedFormat, image.width, image.height, image.mipLevels, 0, sourceSize, sourceTime };
+	
+	std::error_code ec;
+	std::filesystem::create_directories(exeDirPath + "texcache", ec);
+	
+	writeFileReplacing(textureCachePath(image.path), [&] (std::ostream& stream) {
+		stream.write((const char*)&header, sizeof(header));
+		stream.write((const char*)levelSizes.data(), levelSizes.size() * sizeof(uint32_t));
+		stream.write(levelsData.data(), levelsData.size());
+	});
+}
+
+bool textureDecodesDone() {
+	std::lock_guard<std::mutex> lock(decodeMutex);
+	return std::all_of(pendingImages.begin(), pendingImages.end(), [] (const std::unique_ptr<PendingImage>& image) { return image->decoded; });
+}
+
+void finishTextureLoads() {
+	//Images are uploaded in the order they were queued as soon as each one is decoded, while later ones are still decoding
+	std::vector<GLuint> texturesToMipmap;
+	uint32_t numFromCache = 0;
+	for (const std::unique_ptr<PendingImage>& image : pendingImages) {
+		{
+			std::unique_lock<std::mutex> lock(decodeMutex);
+			decodedCv.wait(lock, [&] { return image->decoded; });
+		}
+		if (!image->error.empty()) {
+			std::cerr << "image failed to load: '" << image->path << "': " << image->error << std::endl;
+			std::abort();
+		}
+		
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, image->stagingBuffer);
+		if (image->fromCache) {
+			uintptr_t offset = 0;
+			for (uint32_t level = 0; level < image->mipLevels; level++) {
+				const uint32_t levelWidth = std::max(image->width >> level, 1U);
+				const uint32_t levelHeight = std::max(image->height >> level, 1U);
+				const uint32_t levelSize = image->cachedLevelSizes[level];
+				if (image->layer == -1) {
+					glCompressedTextureSubImage2D(image->texture, level, 0, 0, levelWidth, levelHeight,
+						image->compressedFormat, levelSize, (const void*)offset);
+				} else {
+					glCompressedTextureSubImage3D(image->texture, level, 0, 0, image->layer, levelWidth, levelHeight, 1,
+						image->compressedFormat, levelSize, (const void*)offset);
+				}
+				offset += levelSize;
+			}
+			numFromCache++;
+		} else if (image->layer == -1) {
+			glTextureSubImage2D(image->texture, 0, 0, 0, image->width, image->height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		} else {
+			glTextureSubImage3D(image->texture, 0, 0, 0, image->layer, image->width, image->height, 1, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glDeleteBuffers(1, &image->stagingBuffer);
+		
+		if (image->generateMipmaps && !image->fromCache &&
+				std::find(texturesToMipmap.begin(), texturesToMipmap.end(), image->texture) == texturesToMipmap.end()) {
+			texturesToMipmap.push_back(image->texture);
+		}
+	}
 	
-	if (generateMipmaps) {
+	for (GLuint texture : texturesToMipmap) {
 		glGenerateTextureMipmap(texture);
 	}
+	
+	//The images that weren't in the cache are compressed now so that the next start can load them directly
+	for (const std::unique_ptr<PendingImage>& image : pendingImages) {
+		if (image->compressedFormat != 0 && !image->fromCache) {
+			writeTextureCache(*image);
+		}
+	}
+	
+#ifdef DEBUG
+	std::cout << "loaded " << pendingImages.size() << " images, " << numFromCache << " from the compressed texture cache" << std::endl;
+#endif
+	
+	jobs::wait(decodeJobs);
+	pendingImages.clear();
 }
 
 void Texture::initialize() {
@@ -53,11 +337,7 @@ void Texture::bind(int unit) const {
 	glBindTextureUnit(unit, texture);
 }
 
-GLuint loadTextureCube(const std::string& dirPath, int resolution) {
-	GLuint texture;
-	glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &texture);
-	glTextureStorage2D(texture, (int)log2(resolution) + 1, GL_SRGB8, resolution, resolution);
-	
+GLuint loadTextureCube(const std::string& dirPath, int resolution, GLenum compressedFormat) {
 	static std::string layerNames[] = {
 		"1.jpg",
 		"3.jpg",
@@ -67,22 +347,39 @@ GLuint loadTextureCube(const std::string& dirPath, int resolution) {
 		"4.jpg"
 	};
 	
+	const uint32_t mipLevels = (uint32_t)log2(resolution) + 1;
+	if (compressedFormat != 0 && !compressedFormatSupported(compressedFormat)) {
+		compressedFormat = 0;
+	}
+	
+	//The compressed format can only be used if every face is in the cache
+	std::unique_ptr<PendingImage> layerImages[6];
+	bool allFromCache = compressedFormat != 0;
 	for (int i = 0; i < 6; i++) {
-		std::string path = dirPath + layerNames[i];
+		layerImages[i] = std::make_unique<PendingImage>();
+		PendingImage& image = *layerImages[i];
+		image.path = dirPath + layerNames[i];
+		image.layer = i;
+		image.width = resolution;
+		image.height = resolution;
+		image.mipLevels = mipLevels;
+		image.generateMipmaps = true;
+		image.compressedFormat = compressedFormat;
 		
-		int layerWidth, layerHeight;
-		uint8_t* data = stbi_load(path.c_str(), (int*)&layerWidth, (int*)&layerHeight, nullptr, 4);
-		if (data == nullptr) {
-			std::cerr << stbi_failure_reason() << std::endl;
-			std::abort();
-		}
-		assert(layerWidth == resolution && layerHeight == resolution);
-		
-		glTextureSubImage3D(texture, 0, 0, 0, i, resolution, resolution, 1, GL_RGBA, GL_UNSIGNED_BYTE, data);
-		free(data);
+		uint32_t cachedWidth, cachedHeight;
+		allFromCache = allFromCache && readTextureCacheHeader(image.path, compressedFormat, mipLevels,
+			cachedWidth, cachedHeight, image.cachedLevelSizes) && cachedWidth == (uint32_t)resolution && cachedHeight == (uint32_t)resolution;
 	}
 	
-	glGenerateTextureMipmap(texture);
+	GLuint texture;
+	glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &texture);
+	glTextureStorage2D(texture, mipLevels, allFromCache ? compressedFormat : GL_SRGB8, resolution, resolution);
+	
+	for (int i = 0; i < 6; i++) {
+		layerImages[i]->texture = texture;
+		layerImages[i]->fromCache = allFromCache;
+		queueImage(std::move(layerImages[i]));
+	}
 	
 	return texture;
 }
@@ -11,7 +11,9 @@ struct Texture {
 	GLuint texture;
 	bool initialized = false;
 	
-	void load(const std::string& path, bool srgb, bool generateMipmaps);
+	//Creates the texture right away, but the image is decoded on another thread and only uploaded by finishTextureLoads.
+	// If compressedFormat is a supported block compressed format, the image is stored in the texture cache in that format.
+	void load(const std::string& path, bool srgb, bool generateMipmaps, GLenum compressedFormat = 0);
 	
 	void initialize();
 	void setParamsForFramebuffer();
@@ -23,4 +25,10 @@ struct Texture {
 	void bind(int unit) const;
 };
 
-GLuint loadTextureCube(const std::string& dirPath, int resolution);
+GLuint loadTextureCube(const std::string& dirPath, int resolution, GLenum compressedFormat = 0);
+
+//Returns true once every queued image has been decoded, so that finishTextureLoads doesn't need to wait
+bool textureDecodesDone();
+
+//Waits for the images queued by Texture::load and loadTextureCube to be decoded and uploads them
+void finishTextureLoads();
@@ -85,6 +85,7 @@ namespace ui {
 		shader.attachStage(GL_VERTEX_SHADER, "ui.vs.glsl");
 		shader.attachStage(GL_FRAGMENT_SHADER, "ui.fs.glsl");
 		shader.link("ui");
+		shader.onReload = [] { glProgramUniform2f(shader.program, 0, 1.0f / texture.width, 1.0f / texture.height); };
 		
 		const uint8_t spriteVertices[] = { 0, 0, 0, 1, 1, 0, 1, 1 };
 		glCreateBuffers(1, &spriteVertexBuffer);
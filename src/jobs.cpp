@@ -0,0 +1,152 @@
+#include "jobs.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+void (*jobs::onJobFinished)(const char* name, uint64_t nanoseconds) = nullptr;
+
+struct Job {
+	const char* name;
+	std::function<void()> function;
+	jobs::Counter* counter;
+};
+
+struct JobQueue {
+	std::mutex mutex;
+	std::deque<Job> jobs;
+};
+
+//Queue 0 is shared by the threads that aren't workers, worker i uses queue i + 1
+static std::vector<std::unique_ptr<JobQueue>> queues;
+static std::vector<std::thread> workers;
+static thread_local uint32_t currentQueue = 0;
+
+//Jobs that are queued but haven't been taken yet, workers sleep while there are none
+static std::atomic<uint32_t> numQueuedJobs = 0;
+static std::mutex sleepMutex;
+static std::condition_variable sleepCv;
+static bool stopWorkers = false;
+
+static bool takeJob(Job& jobOut) {
+	//The newest job in the own queue is taken first since its data is most likely still in the cache
+	{
+		JobQueue& queue = *queues[currentQueue];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty()) {
+			jobOut = std::move(queue.jobs.back());
+			queue.jobs.pop_back();
+			numQueuedJobs--;
+			return true;
+		}
+	}
+	
+	//Other queues are stolen from at the front, which tends to be the larger pieces of work
+	for (size_t i = 1; i < queues.size(); i++) {
+		JobQueue& queue = *queues[(currentQueue + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty()) {
+			jobOut = std::move(queue.jobs.front());
+			queue.jobs.pop_front();
+			numQueuedJobs--;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void runJob(Job& job) {
+	const auto startTime = std::chrono::steady_clock::now();
+	job.function();
+	if (jobs::onJobFinished != nullptr) {
+		const auto elapsed = std::chrono::steady_clock::now() - startTime;
+		jobs::onJobFinished(job.name, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+	}
+	if (job.counter != nullptr) {
+		job.counter->remaining--;
+	}
+}
+
+static void workerMain(uint32_t queueIndex) {
+	currentQueue = queueIndex;
+	while (true) {
+		Job job;
+		if (takeJob(job)) {
+			runJob(job);
+			continue;
+		}
+		
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleepCv.wait(lock, [] { return stopWorkers || numQueuedJobs > 0; });
+		if (stopWorkers && numQueuedJobs == 0)
+			return;
+	}
+}
+
+void jobs::initialize() {
+	const uint32_t numThreads = std::max(std::thread::hardware_concurrency(), 2U) - 1;
+	queues.resize(numThreads + 1);
+	for (std::unique_ptr<JobQueue>& queue : queues) {
+		queue = std::make_unique<JobQueue>();
+	}
+	for (uint32_t i = 0; i < numThreads; i++) {
+		workers.emplace_back(workerMain, i + 1);
+	}
+}
+
+void jobs::shutdown() {
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopWorkers = true;
+	}
+	sleepCv.notify_all();
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+	workers.clear();
+}
+
+uint32_t jobs::numWorkers() {
+	return workers.size();
+}
+
+void jobs::run(const char* name, std::function<void()> job, Counter* counter) {
+	if (counter != nullptr) {
+		counter->remaining++;
+	}
+	{
+		JobQueue& queue = *queues[currentQueue];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back(Job { name, std::move(job), counter });
+		numQueuedJobs++;
+	}
+	
+	//Locking makes sure that a worker which just saw no jobs is waiting before it's notified
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	sleepCv.notify_one();
+}
+
+void jobs::wait(Counter& counter) {
+	while (!counter.done()) {
+		Job job;
+		if (takeJob(job)) {
+			runJob(job);
+		} else {
+			std::this_thread::yield();
+		}
+	}
+}
+
+void jobs::parallelFor(const char* name, uint32_t count, uint32_t grainSize, const std::function<void(uint32_t, uint32_t)>& body) {
+	Counter counter;
+	for (uint32_t begin = 0; begin < count; begin += grainSize) {
+		const uint32_t end = std::min(begin + grainSize, count);
+		run(name, [&body, begin, end] { body(begin, end); }, &counter);
+	}
+	wait(counter);
+}
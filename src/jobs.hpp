@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+
+//Work stealing job scheduler. Every worker has its own queue which it takes jobs from the back of,
+// when that is empty it steals from the front of the other queues. Threads that aren't workers share one queue.
+namespace jobs {
+	//Counts the unfinished jobs that were started with it
+	struct Counter {
+		std::atomic<uint32_t> remaining = 0;
+		
+		bool done() const {
+			return remaining.load() == 0;
+		}
+	};
+	
+	//Starts one worker for every core except the one used by the main thread
+	void initialize();
+	
+	//Waits for the queued jobs to finish and stops the workers
+	void shutdown();
+	
+	uint32_t numWorkers();
+	
+	//Queues a job on the calling thread's queue. The name must outlive the job, it is passed to onJobFinished.
+	void run(const char* name, std::function<void()> job, Counter* counter = nullptr);
+	
+	//Runs queued jobs on the calling thread until the counter reaches zero
+	void wait(Counter& counter);
+	
+	//Calls body with ranges of at most grainSize indices that cover [0, count), in parallel.
+	// The calling thread takes part and this returns once every range is done.
+	void parallelFor(const char* name, uint32_t count, uint32_t grainSize, const std::function<void(uint32_t, uint32_t)>& body);
+	
+	//Called on the thread that ran the job after every job, with the time it took
+	extern void (*onJobFinished)(const char* name, uint64_t nanoseconds);
+}
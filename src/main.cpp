@@ -5,10 +5,10 @@
 #include "ship.hpp"
 #include "settings.hpp"
 #include "utils.hpp"
+#include "jobs.hpp"
 #include "target.hpp"
 #include "graphics/opengl.hpp"
 #include "graphics/ui.hpp"
-#include "graphics/sphere.hpp"
 #include "graphics/particles.hpp"
 #include "graphics/shadows.hpp"
 #include "graphics/asteroids.hpp"
@@ -20,6 +20,9 @@
 #include "menu.hpp"
 
 #include <iomanip>
+#include <map>
+#include <mutex>
+#include <numeric>
 
 #ifdef _WIN32
 extern "C"
@@ -29,6 +32,59 @@ extern "C"
 }
 #endif
 
+static void printBenchmarkResults(std::vector<float>& cpuFrameTimes, std::vector<float>& gpuFrameTimes) {
+	auto printStats = [&] (std::string_view name, std::vector<float>& times) {
+		std::sort(times.begin(), times.end());
+		const float average = std::accumulate(times.begin(), times.end(), 0.0f) / (float)times.size();
+		std::cout << "  " << name << ": avg " << average << "ms, median " << times[times.size() / 2] << "ms, "
+			"99th percentile " << times[times.size() * 99 / 100] << "ms" << std::endl;
+	};
+	
+	std::cout << std::setprecision(3) << std::fixed << "benchmark with world size " << settings::worldSize << " ("
+		<< asteroidBoxSize << "m box, " << numAsteroids << " asteroids), " << cpuFrameTimes.size() << " frames" << std::endl;
+	if (!cpuFrameTimes.empty()) {
+		printStats("frame", cpuFrameTimes);
+		printStats("gpu", gpuFrameTimes);
+	}
+}
+
+#ifdef DEBUG
+//Number of jobs and total time in milliseconds by job name, printed once startup is done
+static std::mutex jobTimesMutex;
+static std::map<std::string_view, std::pair<uint32_t, double>> jobTimes;
+
+static void recordJobTime(const char* name, uint64_t nanoseconds) {
+	std::lock_guard<std::mutex> lock(jobTimesMutex);
+	auto& [count, totalTime] = jobTimes[name];
+	count++;
+	totalTime += (double)nanoseconds / 1E6;
+}
+#endif
+
+//Drawn with scissored clears, since the shaders and textures are what is still loading
+static void drawLoadingScreen(SDL_Window* window, float progress) {
+	int width, height;
+	SDL_GL_GetDrawableSize(window, &width, &height);
+	
+	const int barWidth = width / 3;
+	const int barHeight = 4;
+	const int barX = (width - barWidth) / 2;
+	const int barY = (height - barHeight) / 2;
+	
+	const float backgroundColor[] = { 0, 0, 0, 1 };
+	const float barBackgroundColor[] = { 0.1f, 0.1f, 0.1f, 1 };
+	const float barColor[] = { 0.6f, 0.77f, 0.91f, 1 };
+	
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glClearNamedFramebufferfv(0, GL_COLOR, 0, backgroundColor);
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(barX, barY, barWidth, barHeight);
+	glClearNamedFramebufferfv(0, GL_COLOR, 0, barBackgroundColor);
+	glScissor(barX, barY, (int)std::round(barWidth * progress), barHeight);
+	glClearNamedFramebufferfv(0, GL_COLOR, 0, barColor);
+	glDisable(GL_SCISSOR_TEST);
+}
+
 int main() {
 	if (SDL_Init(SDL_INIT_VIDEO)) {
 		std::cerr << SDL_GetError() << std::endl;
@@ -103,20 +159,83 @@ int main() {
 	}, nullptr);
 #endif
 	
+	const uint64_t beforeInitialize = SDL_GetPerformanceCounter();
+	
+#ifdef DEBUG
+	jobs::onJobFinished = recordJobTime;
+#endif
+	jobs::initialize();
+	
+	//These only queue work for the other threads and the driver, which the loading screen waits for
 	initializeShadowMapping();
+	loadAsteroidShaders();
+	startAsteroidGeneration();
 	ui::initialize();
 	Model::initializeVao();
 	res::load();
 	
 	renderer::initialize();
 	Ship::initShaders();
-	generateSphereMeshes();
-	initializeTargetShader();
 	initializeParticles();
+	
+	const uint64_t perfCounterFrequency = SDL_GetPerformanceFrequency();
+	const uint64_t firstLoadingFrame = SDL_GetPerformanceCounter();
+	
+	bool shouldClose = false;
+	while (true) {
+		//Checked before drawing so that compiled shaders are handled every frame
+		const bool shadersDone = pollShaderCompilation();
+		if (isAsteroidGenerationDone() && textureDecodesDone() && shadersDone)
+			break;
+		
+		SDL_Event event;
+		while (SDL_PollEvent(&event)) {
+			if (event.type == SDL_QUIT)
+				shouldClose = true;
+		}
+		if (shouldClose)
+			break;
+		
+		drawLoadingScreen(window, asteroidGenerationProgress());
+		SDL_GL_SwapWindow(window);
+		
+		//Leaves the cpu to the generation threads when vsync is off
+		SDL_Delay(5);
+	}
+	
+	//The rest of initialization is skipped when the window is closed while loading. The window is hidden
+	// right away since the jobs that are still running have to finish before the workers can stop.
+	if (shouldClose) {
+		SDL_HideWindow(window);
+		jobs::shutdown();
+		SDL_GL_DeleteContext(glContext);
+		SDL_DestroyWindow(window);
+		SDL_Quit();
+		return 0;
+	}
+	
+	//The sphere meshes used by the targets are generated with the asteroids
+	initializeTargetShader();
 	initializeAsteroids();
+	finishTextureLoads();
+	bakeAsteroidImpostors();
 	
 	uint64_t lastFrameBegin = SDL_GetPerformanceCounter();
-	const uint64_t perfCounterFrequency = SDL_GetPerformanceFrequency();
+	
+	std::cout << "initialized in " << (1000 * (lastFrameBegin - beforeInitialize) / perfCounterFrequency) << "ms "
+		"(loading screen after " << (1000 * (firstLoadingFrame - beforeInitialize) / perfCounterFrequency) << "ms), "
+		<< shaderCacheStats.loaded << " shaders loaded from cache, " << shaderCacheStats.compiled << " compiled" << std::endl;
+	
+#ifdef DEBUG
+	{
+		std::lock_guard<std::mutex> lock(jobTimesMutex);
+		std::cout << "startup jobs on " << jobs::numWorkers() << " workers:";
+		for (const auto& [name, countAndTime] : jobTimes) {
+			std::cout << " " << name << " " << countAndTime.first << "x " << std::setprecision(1) << std::fixed << countAndTime.second << "ms,";
+		}
+		std::cout << std::defaultfloat << std::endl;
+	}
+#endif
 	
 	GLsync fences[renderer::frameCycleLen] = { };
 	
@@ -139,10 +258,24 @@ int main() {
 	ui::Button gameOverPlayAgain = { "Play Again" };
 	ui::Button gameOverMainMenu = { "Main Menu" };
 	
-	bool shouldClose = false;
+	//When benchmarking, frame times of the menu fly-through are recorded after a warmup period
+	constexpr uint64_t BENCHMARK_WARMUP_SECONDS = 2;
+	const uint64_t benchmarkStart = lastFrameBegin + BENCHMARK_WARMUP_SECONDS * perfCounterFrequency;
+	const uint64_t benchmarkEnd = benchmarkStart + settings::benchmarkTime * perfCounterFrequency;
+	std::vector<float> benchmarkCpuFrameTimes;
+	std::vector<float> benchmarkGpuFrameTimes;
+	
 	while (!shouldClose) {
 		const uint64_t thisFrameBegin = SDL_GetPerformanceCounter();
 		dt = std::min((thisFrameBegin - lastFrameBegin) / (float)perfCounterFrequency, 0.1f);
+		if (settings::benchmarkTime != 0 && thisFrameBegin > benchmarkStart) {
+			benchmarkCpuFrameTimes.push_back(1000 * (float)(thisFrameBegin - lastFrameBegin) / (float)perfCounterFrequency);
+			benchmarkGpuFrameTimes.push_back(renderer::gpuFrameTime);
+			if (thisFrameBegin > benchmarkEnd) {
+				printBenchmarkResults(benchmarkCpuFrameTimes, benchmarkGpuFrameTimes);
+				shouldClose = true;
+			}
+		}
 		lastFrameBegin = thisFrameBegin;
 		prevInput = curInput;
 		curInput.mouseDX = 0;
@@ -176,6 +309,8 @@ int main() {
 					game.remTime = 60;
 				if (event.key.keysym.scancode == SDL_SCANCODE_F5)
 					collisionDebug::enabled = !collisionDebug::enabled;
+				if (event.key.keysym.scancode == SDL_SCANCODE_F8)
+					settings::computeBloom = !settings::computeBloom;
 #endif
 				if (event.key.keysym.scancode == SDL_SCANCODE_C)
 					game.ship.stopped = true;
@@ -199,6 +334,10 @@ int main() {
 		}
 #endif
 		
+		if (settings::shaderHotReload) {
+			reloadChangedShaders();
+		}
+		
 		if (inGame) {
 			game.runFrame(curInput, prevInput);
 		}
@@ -214,6 +353,7 @@ int main() {
 		int drawableWidth, drawableHeight;
 		SDL_GL_GetDrawableSize(window, &drawableWidth, &drawableHeight);
 		renderer::updateFramebuffers(drawableWidth, drawableHeight);
+		renderer::updateDynamicResolution();
 		
 		RenderSettings renderSettings;
 		if (inGame) {
@@ -224,16 +364,21 @@ int main() {
 		
 		ShadowMapMatrices shadowMapMatrices = calculateShadowMapMatrices(renderSettings.vpMatrixInverse, SUN_DIR);
 		std::copy_n(shadowMapMatrices.matrices, NUM_SHADOW_CASCADES, renderSettings.shadowMatrices);
+		renderSettings.renderScale = renderer::getRenderScale();
 		renderer::updateRenderSettings(renderSettings);
 		
 		if (!frustumPlanesFrozen) {
 			frustumPlanes = createFrustumPlanes(renderSettings.vpMatrixInverse);
-			prepareAsteroids(frustumPlanes.data(), shadowMapMatrices.frustumPlanes);
+			prepareAsteroids(frustumPlanes.data(), shadowMapMatrices);
 		}
 		
-		renderShadows([&] (uint32_t cascade) {
-			drawAsteroidsShadow(cascade, shadowMapMatrices.matrices[cascade]);
-		});
+		if (!shadowLayerExtension.empty()) {
+			renderShadowsLayered(shadowMapMatrices, drawAsteroidsShadowLayered);
+		} else {
+			renderShadows(shadowMapMatrices, [&] (uint32_t cascade) {
+				drawAsteroidsShadow(cascade, shadowMapMatrices.matrices[cascade]);
+			});
+		}
 		
 		renderer::beginMainPass();
 		
@@ -242,11 +387,18 @@ int main() {
 		if (inGame) {
 			game.ship.draw();
 		}
-		drawAsteroids(drawAsteroidsWireframe);
+		drawAsteroids(drawAsteroidsWireframe, false);
+		if (settings::occlusionCulling) {
+			if (!frustumPlanesFrozen) {
+				renderer::buildDepthPyramid();
+				cullOccludedAsteroids();
+			}
+			drawAsteroids(drawAsteroidsWireframe, true);
+		}
 		renderer::drawSkybox();
 		
 		if (inGame) {
-			beginDrawTargets();
+			beginDrawTargets(game.targets, renderSettings.vpMatrix);
 			for (Target& target : game.targets) {
 				drawTarget(target, game.targetsAlpha);
 			}
@@ -320,14 +472,20 @@ int main() {
 			stream << std::setprecision(2) << std::fixed << f;
 			return stream.str();
 		};
-		const glm::vec3 truePos = game.ship.pos + glm::vec3(game.ship.boxIndex) * ASTEROID_BOX_SIZE;
+		const glm::vec3 renderPos = toRenderSpace(game.ship.pos);
 		std::string debugLines[] = {
 			"vel: " + floatToStr(game.ship.forwardVel),
-			"tpos: " + floatToStr(truePos.x) + ", " + floatToStr(truePos.y) + ", " + floatToStr(truePos.z),
-			"bpos: " + floatToStr(game.ship.pos.x) + ", " + floatToStr(game.ship.pos.y) + ", " + floatToStr(game.ship.pos.z),
-			"box: " + std::to_string(game.ship.boxIndex.x) + ", " + std::to_string(game.ship.boxIndex.y) + ", " + std::to_string(game.ship.boxIndex.z),
+			"pos: " + floatToStr(game.ship.pos.x) + ", " + floatToStr(game.ship.pos.y) + ", " + floatToStr(game.ship.pos.z),
+			"rpos: " + floatToStr(renderPos.x) + ", " + floatToStr(renderPos.y) + ", " + floatToStr(renderPos.z),
+			"origin: " + floatToStr(renderOrigin.x) + ", " + floatToStr(renderOrigin.y) + ", " + floatToStr(renderOrigin.z),
 			"atot: " + std::to_string(numAsteroids),
+			"afru: " + std::to_string(asteroidCullStats.inFrustum),
+			"aocc: " + std::to_string(asteroidCullStats.occluded) + " (+" + std::to_string(asteroidCullStats.drawnSecondPass) + " late)",
 			"lod bias: " + floatToStr(globalLodBias),
+			"shadow redraws: " + floatToStr(shadowCascadeRedraws) + " of " + std::to_string(NUM_SHADOW_CASCADES) + " cascades",
+			"bloom: " + floatToStr(renderer::bloomGpuTimes[0]) + "ms fragment, " + floatToStr(renderer::bloomGpuTimes[1]) + "ms compute" +
+				(settings::computeBloom ? " (compute)" : " (fragment)"),
+			"res: " + std::to_string(renderer::renderWidth) + "x" + std::to_string(renderer::renderHeight) + (settings::dynamicResolution ? " (dynamic)" : ""),
 			(game.ship.intersected ? "int: true" : "int: false"),
 			"fps: " + floatToStr(1.0f / dt),
 			"frame: " + floatToStr(1000 * (float)elapsedTicks / (float)perfCounterFrequency) + "ms",
@@ -374,6 +532,9 @@ int main() {
 		prevFrameAfterSwap = SDL_GetPerformanceCounter();
 	}
 	
+	stopAsteroidStreaming();
+	jobs::shutdown();
+	
 	SDL_GL_DeleteContext(glContext);
 	SDL_DestroyWindow(window);
 	SDL_Quit();
@@ -92,7 +92,10 @@ void menu::initRenderSettings(uint32_t drawableWidth, uint32_t drawableHeight, R
 	float roll = gameTime * CAMERA_ROLL_SPEED;
 	glm::vec3 up(std::sin(roll), 0, std::cos(roll));
 	
-	glm::vec3 cameraPos = glm::mod(cameraFlyDir * gameTime * CAMERA_FLY_SPEED, ASTEROID_BOX_SIZE);
+	const glm::dvec3 flyPos = glm::dvec3(cameraFlyDir) * ((double)gameTime * CAMERA_FLY_SPEED);
+	updateAsteroidChunks(flyPos);
+	
+	const glm::vec3 cameraPos = toRenderSpace(flyPos);
 	glm::mat4 viewMatrix = glm::lookAt(cameraPos, cameraPos + cameraFlyDir, up);
 	glm::mat4 viewMatrixInv = glm::inverse(viewMatrix);
 	
@@ -108,6 +111,4 @@ void menu::initRenderSettings(uint32_t drawableWidth, uint32_t drawableHeight, R
 	renderSettings.sunDir = SUN_DIR;
 	renderSettings.plColor = glm::vec3(0);
 	renderSettings.plPosition = glm::vec3(0);
-	
-	updateAsteroidWrapping(cameraPos);
 }
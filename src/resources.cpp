@@ -10,9 +10,10 @@ GLuint res::skybox;
 
 void res::load() {
 	shipModel.loadObj(exeDirPath + "res/ship.obj");
-	shipAlbedo.load(exeDirPath + "res/textures/shipDiffuse.png", true, true);
-	shipNormals.load(exeDirPath + "res/textures/shipNormals.png", false, true);
-	asteroidAlbedo.load(exeDirPath + "res/textures/asteroidDiffuse.jpg", true, true);
-	asteroidNormals.load(exeDirPath + "res/textures/asteroidNormals.jpg", false, true);
-	skybox = loadTextureCube(exeDirPath + "res/textures/skybox/", 1024);
+	shipAlbedo.load(exeDirPath + "res/textures/shipDiffuse.png", true, true, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT);
+	shipNormals.load(exeDirPath + "res/textures/shipNormals.png", false, true, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+	asteroidAlbedo.load(exeDirPath + "res/textures/asteroidDiffuse.jpg", true, true, GL_COMPRESSED_SRGB_S3TC_DXT1_EXT);
+	//Only the red and green channels of the asteroid normal map are used
+	asteroidNormals.load(exeDirPath + "res/textures/asteroidNormals.jpg", false, true, GL_COMPRESSED_RG_RGTC2);
+	skybox = loadTextureCube(exeDirPath + "res/textures/skybox/", 1024, GL_COMPRESSED_SRGB_S3TC_DXT1_EXT);
 }
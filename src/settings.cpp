@@ -7,11 +7,21 @@
 namespace settings {
 	bool fullscreen         = false;
 	bool bloom              = true;
+	bool computeBloom       = false;
 	bool vsync              = false;
 	bool mouseInput         = false;
+	bool occlusionCulling   = true;
+	bool clusterCulling     = true;
+	bool impostors          = true;
+	bool shadowSphereFit    = false;
+	bool dynamicResolution  = false;
+	bool shaderHotReload    = false;
+	bool gpuAsteroidPlacement = false;
 	uint32_t shadowRes      = 1024;
 	uint32_t worldSize      = 4;
 	uint32_t lodDist        = 300;
+	uint32_t targetFps      = 60;
+	uint32_t benchmarkTime  = 0;
 	
 	void parse() {
 		std::vector<std::pair<std::string, std::string>> settings;
@@ -47,10 +57,21 @@ namespace settings {
 		
 		getBool("fullscreen", fullscreen);
 		getBool("bloom", bloom);
+		getBool("computeBloom", computeBloom);
 		getBool("vsync", vsync);
 		getBool("mouseInput", mouseInput);
+		getBool("occlusionCulling", occlusionCulling);
+		getBool("clusterCulling", clusterCulling);
+		getBool("impostors", impostors);
+		getBool("shadowSphereFit", shadowSphereFit);
+		getBool("dynamicResolution", dynamicResolution);
+		getBool("shaderHotReload", shaderHotReload);
+		getBool("gpuAsteroidPlacement", gpuAsteroidPlacement);
 		getUInt("shadowRes", shadowRes, 128);
+		getUInt("worldSize", worldSize, 1);
 		worldSize = glm::clamp(worldSize, 1U, 5U);
 		getUInt("lodDist", lodDist, 100);
+		getUInt("targetFps", targetFps, 20);
+		getUInt("benchmarkTime", benchmarkTime, 0);
 	}
 }
@@ -3,10 +3,21 @@
 namespace settings {
 	extern bool fullscreen;
 	extern bool bloom;
+	extern bool computeBloom;
 	extern bool vsync;
 	extern bool mouseInput;
+	extern bool occlusionCulling;
+	extern bool clusterCulling;
+	extern bool impostors;
+	extern bool shadowSphereFit;
+	extern bool dynamicResolution;
+	extern bool shaderHotReload;
+	extern bool gpuAsteroidPlacement;
 	extern uint32_t shadowRes;
+	extern uint32_t worldSize;
 	extern uint32_t lodDist;
+	extern uint32_t targetFps;
+	extern uint32_t benchmarkTime;
 	
 	void parse();
 }
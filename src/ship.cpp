@@ -93,34 +93,34 @@ void Ship::update(const InputState& curInput, const InputState& prevInput) {
 	glm::mat4 rotationMatrix = glm::rotate(glm::mat4(1), rollOffset, rollAxis) * glm::mat4_cast(rotation);
 	glm::mat4 invRotationMatrix = glm::transpose(rotationMatrix);
 	
-	//Updates the camera
+	//Updates the camera, the view matrix is built relative to the ship until the render origin is known
 	cameraRotation = glm::slerp(cameraRotation, rotation, std::min(2 * dt, 1.0f));
-	viewMatrix =
+	const glm::mat4 shipViewMatrix =
 		glm::lookAt(glm::vec3(0, 5, -14), glm::vec3(0, 3, 0), glm::vec3(0, 1, 0)) *
 		glm::transpose(glm::mat4_cast(cameraRotation)) *
-		glm::translate(glm::mat4(1), -pos - moveVector);
-	viewMatrixInv = glm::inverse(viewMatrix);
-	cameraPosition = glm::vec3(viewMatrixInv[3]);
+		glm::translate(glm::mat4(1), -moveVector);
+	const glm::dvec3 cameraWorldPos = pos + glm::dvec3(glm::inverse(shipViewMatrix)[3]);
+	
+	updateAsteroidChunks(cameraWorldPos);
 	
-	updateAsteroidWrapping(cameraPosition);
+	const glm::vec3 renderPos = toRenderSpace(pos);
+	viewMatrix = shipViewMatrix * glm::translate(glm::mat4(1), -renderPos);
+	viewMatrixInv = glm::inverse(viewMatrix);
+	cameraPosition = toRenderSpace(cameraWorldPos);
 	
 	//Collision detection
 	const glm::vec3 aabbScale(0.8f, 0.7f, 1);
-	const glm::mat4 colCheckWorldMatrix = glm::translate(glm::mat4(1), pos) * rotationMatrix;
-	const glm::mat4 colCheckWorldMatrixInv = invRotationMatrix * glm::translate(glm::mat4(1), -pos);
+	const glm::mat4 colCheckWorldMatrix = glm::translate(glm::mat4(1), renderPos) * rotationMatrix;
+	const glm::mat4 colCheckWorldMatrixInv = invRotationMatrix * glm::translate(glm::mat4(1), -renderPos);
 	const glm::vec3 moveLocalSpace(invRotationMatrix * glm::vec4(moveVector, 1));
 	intersected = anyAsteroidIntersects(
 		res::shipModel.minPos * aabbScale + glm::min(moveLocalSpace, glm::vec3(0)),
 		res::shipModel.maxPos * aabbScale + glm::max(moveLocalSpace, glm::vec3(0)),
 		colCheckWorldMatrix, colCheckWorldMatrixInv);
 	
-	pos += moveVector;
-	glm::ivec3 boxOffset(glm::floor(pos / ASTEROID_BOX_SIZE));
-	boxIndex += boxOffset;
-	glm::vec3 boxOffsetShift = glm::vec3(boxOffset) * ASTEROID_BOX_SIZE;
-	pos -= boxOffsetShift;
+	pos += glm::dvec3(moveVector);
 	
-	worldMatrix = glm::translate(glm::mat4(1), pos) * rotationMatrix;
+	worldMatrix = glm::translate(glm::mat4(1), renderPos + moveVector) * rotationMatrix;
 }
 
 static Shader modelShader, emissiveShader;
@@ -16,8 +16,7 @@ struct Ship {
 	bool stopped = false;
 	bool intersected = false;
 	
-	glm::ivec3 boxIndex;
-	glm::vec3 pos { 0, 0, 0 };
+	glm::dvec3 pos { 0, 0, 0 };
 	glm::vec3 vel { 0, 0, 0 };
 	
 	glm::quat rotation;
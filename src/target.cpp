@@ -13,7 +13,6 @@ constexpr uint32_t TARGET_SPHERE_LOD_LEVEL = 3;
 static_assert(TARGET_SPHERE_LOD_LEVEL < NUM_SPHERE_LODS);
 
 static Shader targetShader;
-static Shader targetMergeShader;
 
 static GLuint targetVertexBuffer;
 static GLuint targetIndexBuffer;
@@ -25,10 +24,7 @@ void initializeTargetShader() {
 	targetShader.attachStage(GL_VERTEX_SHADER, "target.vs.glsl");
 	targetShader.attachStage(GL_FRAGMENT_SHADER, "target.fs.glsl");
 	targetShader.link("target");
-	
-	targetMergeShader.attachStage(GL_VERTEX_SHADER, "fullscreen.vs.glsl");
-	targetMergeShader.attachStage(GL_FRAGMENT_SHADER, "targetmerge.fs.glsl");
-	targetMergeShader.link("targetMerge");
+	targetShader.onReload = [] { glProgramUniform1f(targetShader.program, 2, TARGET_RADIUS); };
 	
 	glCreateBuffers(1, &targetVertexBuffer);
 	glNamedBufferStorage(
@@ -67,18 +63,74 @@ glm::vec4 rotations[3] = {
 bool shouldHideTargetInfo;
 float targetInfoOpacity = 1;
 
-void beginDrawTargets() {
+//The target shader displaces its background lookups by up to this many pixels
+constexpr int TARGET_MAX_DISPLACE = 26;
+
+void beginDrawTargets(std::span<const Target> targets, const glm::mat4& viewProj) {
 	if (shouldHideTargetInfo) {
 		targetInfoOpacity = std::max(targetInfoOpacity - dt * 8, 0.0f);
 	} else {
 		targetInfoOpacity = std::min(targetInfoOpacity + dt * 8, 1.0f);
 	}
 	
-	glBindFramebuffer(GL_FRAMEBUFFER, renderer::targetsPassFbo);
-	const float clearColor[] = { 0, 0, 0, 0 };
-	glClearBufferfv(GL_COLOR, 0, clearColor);
-	const float clearDepth[] = { 1 };
-	glClearBufferfv(GL_DEPTH, 0, clearDepth);
+	const glm::ivec2 screenSize(renderer::renderWidth, renderer::renderHeight);
+	
+	//Finds the screen space rectangle covered by the targets' bounding boxes
+	glm::vec2 ndcMin(INFINITY);
+	glm::vec2 ndcMax(-INFINITY);
+	auto addPoint = [&] (const glm::vec4& hPos) {
+		ndcMin = glm::min(ndcMin, glm::vec2(hPos) / hPos.w);
+		ndcMax = glm::max(ndcMax, glm::vec2(hPos) / hPos.w);
+	};
+	for (const Target& target : targets) {
+		glm::vec4 hCorners[8];
+		int numInFront = 0;
+		for (int c = 0; c < 8; c++) {
+			glm::vec3 corner = target.renderPos + glm::vec3(c & 1 ? 1 : -1, c & 2 ? 1 : -1, c & 4 ? 1 : -1) * TARGET_RADIUS;
+			hCorners[c] = viewProj * glm::vec4(corner, 1);
+			if (hCorners[c].w >= Z_NEAR) {
+				addPoint(hCorners[c]);
+				numInFront++;
+			}
+		}
+		if (numInFront == 0 || numInFront == 8)
+			continue;
+		
+		//The box crosses the near plane, so it's clipped by adding the points where its edges cross it
+		for (int c = 0; c < 8; c++) {
+			for (int axis = 1; axis < 8; axis <<= 1) {
+				const glm::vec4& a = hCorners[c];
+				const glm::vec4& b = hCorners[c | axis];
+				if ((c & axis) || (a.w >= Z_NEAR) == (b.w >= Z_NEAR))
+					continue;
+				addPoint(glm::mix(a, b, (Z_NEAR - a.w) / (b.w - a.w)));
+			}
+		}
+	}
+	if (ndcMin.x > ndcMax.x) {
+		//Every target is behind the near plane
+		ndcMin = ndcMax = glm::vec2(-1);
+	}
+	glm::ivec2 rectMin = glm::clamp(glm::ivec2(glm::floor((ndcMin * 0.5f + 0.5f) * glm::vec2(screenSize))), glm::ivec2(0), screenSize);
+	glm::ivec2 rectMax = glm::clamp(glm::ivec2(glm::ceil((ndcMax * 0.5f + 0.5f) * glm::vec2(screenSize))), glm::ivec2(0), screenSize);
+	
+	//Targets are drawn straight into the main pass, clipped to the rectangle. Since the target shader
+	// samples the main pass, the area it can read is copied beforehand instead of rendering to a separate framebuffer.
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(rectMin.x, rectMin.y, std::max(rectMax.x - rectMin.x, 0), std::max(rectMax.y - rectMin.y, 0));
+	
+	glm::ivec2 copyMin = glm::max(rectMin - TARGET_MAX_DISPLACE, glm::ivec2(0));
+	glm::ivec2 copyMax = glm::min(rectMax + TARGET_MAX_DISPLACE, screenSize);
+	if (copyMax.x > copyMin.x && copyMax.y > copyMin.y) {
+		glCopyImageSubData(
+			renderer::mainPassColorAttachment.texture, GL_TEXTURE_2D, 0, copyMin.x, copyMin.y, 0,
+			renderer::targetsBackgroundColor.texture, GL_TEXTURE_2D, 0, copyMin.x, copyMin.y, 0,
+			copyMax.x - copyMin.x, copyMax.y - copyMin.y, 1);
+		glCopyImageSubData(
+			renderer::mainPassDepthAttachment.texture, GL_TEXTURE_2D, 0, copyMin.x, copyMin.y, 0,
+			renderer::targetsBackgroundDepth.texture, GL_TEXTURE_2D, 0, copyMin.x, copyMin.y, 0,
+			copyMax.x - copyMin.x, copyMax.y - copyMin.y, 1);
+	}
 	
 	glm::mat3 rotationMatrices[3];
 	for (int i = 0; i < 3; i++) {
@@ -87,8 +139,8 @@ void beginDrawTargets() {
 	
 	targetShader.use();
 	glBindVertexArray(targetVertexArray);
-	renderer::mainPassColorAttachment.bind(0);
-	renderer::mainPassDepthAttachment.bind(1);
+	renderer::targetsBackgroundColor.bind(0);
+	renderer::targetsBackgroundDepth.bind(1);
 	targetNoiseTexture.bind(2);
 	glUniformMatrix3fv(3, 3, false, (const float*)rotationMatrices);
 	
@@ -96,19 +148,12 @@ void beginDrawTargets() {
 }
 
 void endDrawTargets() {
-	glBindFramebuffer(GL_FRAMEBUFFER, renderer::mainPassFbo);
-	
-	renderer::targetsPassColorAttachment.bind(0);
-	renderer::targetsPassDepthAttachment.bind(1);
-	
-	targetMergeShader.use();
-	glDrawArrays(GL_TRIANGLES, 0, 3);
-	
-	glDisable(GL_CULL_FACE);
+	glDisable(GL_SCISSOR_TEST);
+	glEnable(GL_CULL_FACE);
 }
 
 void drawTarget(const Target& target, float alpha) {
-	glUniform3fv(0, 1, (const float*)&target.truePos);
+	glUniform3fv(0, 1, (const float*)&target.renderPos);
 	glUniform4f(1, target.color.r, target.color.g, target.color.b, alpha);
 	glDrawElements(GL_TRIANGLES, sphereTriangles[TARGET_SPHERE_LOD_LEVEL].size() * 3, GL_UNSIGNED_INT, nullptr);
 }
@@ -120,7 +165,7 @@ void drawTargetUI(const Target& target, const glm::mat4& viewProj, const glm::ve
 	static Rect ringSrcRect = { glm::vec2(0, 256 - RING_TEX_SIZE), glm::vec2(RING_TEX_SIZE) };
 	static Rect dotSrcRect = { ringSrcRect.min + glm::vec2(RING_TEX_SIZE, RING_TEX_SIZE / 2 - DOT_TEX_SIZE / 2), glm::vec2(DOT_TEX_SIZE) };
 	
-	glm::vec4 hPos = viewProj * glm::vec4(target.truePos, 1);
+	glm::vec4 hPos = viewProj * glm::vec4(target.renderPos, 1);
 	
 	glm::vec2 ndcPos = glm::vec2(hPos) / std::max(std::abs(hPos.w), 0.001f);
 	glm::vec2 screenPos = (glm::vec2(ndcPos) * 0.5f + 0.5f) * screenSize;
@@ -129,7 +174,7 @@ void drawTargetUI(const Target& target, const glm::mat4& viewProj, const glm::ve
 	
 	float opacity = 0.6f;
 	
-	float dist = glm::distance(ship.pos, target.truePos);
+	float dist = (float)glm::distance(ship.pos, target.pos);
 	
 	constexpr float FADE_BEGIN_DIST = 80;
 	constexpr float FADE_END_DIST = 100;
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <span>
+
 constexpr int TARGET_BASE_PTS = 5;
 constexpr int TARGET_TIME_PTS = 1;
 
@@ -8,14 +10,15 @@ constexpr float TARGET_RADIUS = 30;
 void initializeTargetShader();
 
 struct Target {
-	glm::vec3 pos;
-	glm::vec3 truePos;
+	glm::dvec3 pos;
+	//Position relative to the render origin, updated every frame
+	glm::vec3 renderPos;
 	glm::vec3 color;
 };
 
 extern bool shouldHideTargetInfo;
 
-void beginDrawTargets();
+void beginDrawTargets(std::span<const Target> targets, const glm::mat4& viewProj);
 void endDrawTargets();
 
 void drawTarget(const Target& target, float alpha);
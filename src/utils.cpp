@@ -1,8 +1,13 @@
 #include "utils.hpp"
 
+#include <fstream>
+#include <filesystem>
+
 float dt = 0;
 float gameTime = 0;
 
+glm::dvec3 renderOrigin(0.0);
+
 glm::ivec3 maxComputeWorkGroupSize;
 int maxComputeWorkGroupInvocations;
 
@@ -60,3 +65,37 @@ std::array<glm::vec4, 6> createFrustumPlanes(const glm::mat4& inverseViewProj) {
 }
 
 std::string exeDirPath;
+
+bool readSourceInfo(const std::string& path, uint64_t& size, int64_t& time) {
+	std::error_code ec;
+	size = std::filesystem::file_size(path, ec);
+	if (ec)
+		return false;
+	time = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+	return !ec;
+}
+
+bool writeFileReplacing(const std::string& path, const std::function<void(std::ostream&)>& write) {
+	const std::string tempPath = path + ".tmp";
+	{
+		std::ofstream stream(tempPath, std::ios::binary);
+		if (stream) {
+			write(stream);
+			stream.flush();
+		}
+		if (!stream) {
+			stream.close();
+			std::error_code ec;
+			std::filesystem::remove(tempPath, ec);
+			return false;
+		}
+	}
+	
+	std::error_code ec;
+	std::filesystem::rename(tempPath, path, ec);
+	if (ec) {
+		std::filesystem::remove(tempPath, ec);
+		return false;
+	}
+	return true;
+}
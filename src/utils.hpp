@@ -2,6 +2,8 @@
 
 #include <random>
 #include <cmath>
+#include <functional>
+#include <iosfwd>
 
 constexpr float Z_NEAR = 0.1f;
 constexpr float Z_FAR = 5000.0f;
@@ -9,6 +11,14 @@ constexpr float Z_FAR = 5000.0f;
 extern float dt;
 extern float gameTime;
 
+//Simulation positions are stored in double precision world space. Rendering and collision use floats relative
+// to renderOrigin, which updateAsteroidChunks moves along with the camera once per frame.
+extern glm::dvec3 renderOrigin;
+
+inline glm::vec3 toRenderSpace(const glm::dvec3& worldPos) {
+	return glm::vec3(worldPos - renderOrigin);
+}
+
 extern glm::ivec3 maxComputeWorkGroupSize;
 extern int maxComputeWorkGroupInvocations;
 
@@ -36,6 +46,13 @@ std::array<glm::vec4, 6> createFrustumPlanes(const glm::mat4& inverseViewProj);
 
 extern std::string exeDirPath;
 
+//Gets the size and last write time of a file, which caches store to detect that their source has changed
+bool readSourceInfo(const std::string& path, uint64_t& size, int64_t& time);
+
+//Writes a file through a temporary file next to it, which is renamed over it once everything was written.
+// A crash or a full disk leaves the old file, or no file, instead of a partly written one.
+bool writeFileReplacing(const std::string& path, const std::function<void(std::ostream&)>& write);
+
 struct PairIntIntHash {
 	size_t operator()(const std::pair<int, int>& p) const {
 		return (size_t)p.first | ((size_t)p.second << (size_t)32);